@@ -0,0 +1,106 @@
+/********************************************************************************
+* aggregator.cpp: Samlar in utskrifterna frn mnga kort, vart och ett p sin
+*                 egen seriella port, i en enda process (se device_mux.h).
+*
+*                 Anvndning:
+*
+*                 aggregator [-b baud] [-p period_ms] [-o fil] <enhet>...
+*
+*                 - baud     : Baud rate fr seriella portar, frvalt 9600.
+*                 - period_ms: Frvntad tid mellan utskrifter, frvalt
+*                              TMP36_PRINT_PERIOD_MS (en minut).
+*                 - fil      : Fil fr sammanslagen utdata, frvalt stdout.
+*                 - enhet    : Seriella portar eller pseudoterminaler. Textrader
+*                              frn enhet nummer i fr sensor-id i.
+********************************************************************************/
+#include "device_mux.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Stts av signalhanteraren nr programmet ska avslutas. */
+static volatile sig_atomic_t stop_requested = 0;
+
+/********************************************************************************
+* on_signal: Signalhanterare fr SIGINT och SIGTERM.
+********************************************************************************/
+static void on_signal(int)
+{
+   stop_requested = 1;
+   return;
+}
+
+/********************************************************************************
+* main: Lgger till alla enheter och kr multiplexern tills programmet
+*       avbryts, varefter kad utdata skrivs ut och statistik skrivs till
+*       stderr.
+********************************************************************************/
+int main(int argc, char** argv)
+{
+   long baud = 9600;
+   long period_ms = TMP36_PRINT_PERIOD_MS;
+   const char* output = nullptr;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "b:p:o:")) != -1)
+   {
+      switch (opt)
+      {
+      case 'b': baud = strtol(optarg, nullptr, 10); break;
+      case 'p': period_ms = strtol(optarg, nullptr, 10); break;
+      case 'o': output = optarg; break;
+      default: optind = argc + 1; break;
+      }
+   }
+
+   if (optind >= argc || period_ms < 0 || argc - optind > 0xFFFF)
+   {
+      fprintf(stderr, "Anvndning: %s [-b baud] [-p period_ms] [-o fil] <enhet>...\n", argv[0]);
+      return 2;
+   }
+
+   const int output_fd = output ? open(output, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644) : STDOUT_FILENO;
+
+   if (output_fd < 0)
+   {
+      perror(output);
+      return 1;
+   }
+
+   struct sigaction sa;
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = on_signal;
+   sigaction(SIGINT, &sa, nullptr);
+   sigaction(SIGTERM, &sa, nullptr);
+   signal(SIGPIPE, SIG_IGN);
+
+   device_mux mux;
+   if (!mux.init(output_fd, baud, (int64_t)period_ms * 1000000LL)) return 1;
+
+   for (int i = optind; i < argc; ++i)
+   {
+      mux.add_device(argv[i], (uint16_t)(i - optind));
+   }
+
+   bool ok = true;
+
+   while (!stop_requested && ok)
+   {
+      ok = mux.poll_once(1000);
+   }
+
+   ok = mux.flush() && ok;
+
+   const device_mux_stats& stats = mux.stats();
+   fprintf(stderr, "%llu poster, %llu saknade, %llu uppskattat saknade, %llu felaktiga, "
+           "%llu teranslutningar, %llu pauser.\n",
+           (unsigned long long)stats.records, (unsigned long long)stats.missing,
+           (unsigned long long)stats.estimated,
+           (unsigned long long)stats.bad_records, (unsigned long long)stats.reconnects,
+           (unsigned long long)stats.pauses);
+   return ok ? 0 : 1;
+}
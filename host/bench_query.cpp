@@ -0,0 +1,240 @@
+/********************************************************************************
+* bench_query.cpp: Prestandamtning av series.h p en syntetisk seriefil med
+*                  ra AD-resultat, frvalt en miljard vrden (2 GB).
+*
+*                  Anvndning:
+*
+*                  bench_query [-n antal] [-t trdar] [-f fil] [-k]
+*
+*                  - antal : Antal vrden, frvalt 1 000 000 000.
+*                  - trdar: Antal trdar, frvalt en per processorkrna.
+*                  - fil   : Seriefilen, frvalt /tmp/bench_query.ser.
+*                  - k     : Behll filen och teranvnd den om den redan
+*                            har rtt antal vrden.
+********************************************************************************/
+#include "series.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+
+/* Makrodefinitioner: */
+#define BENCH_BUCKETS 1000            /* Antal hinkar vid nedsampling. */
+#define BENCH_LTTB_POINTS 2000        /* Antal punkter vid LTTB. */
+#define BENCH_CONVERT_MAX (1UL << 28) /* Hgst antal vrden vid omvandling. */
+#define BENCH_HOLE_EVERY 1000003      /* Avstnd mellan hl i serien. */
+#define BENCH_HOLE_LEN 1440           /* Saknade vrden per hl (ett dygn). */
+
+/********************************************************************************
+* seconds_now: Returnerar monoton tid i sekunder.
+********************************************************************************/
+static double seconds_now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/********************************************************************************
+* fill_series: Fyller serien med en slumpvandring av AD-resultat kring
+*              rumstemperatur (AD-resultat 100 - 250, cirka 0 - 72 grader).
+*              Varje trd fyller sin del med egen slumpgenerator. Var
+*              BENCH_HOLE_EVERY:e vrde inleds ett hl om BENCH_HOLE_LEN
+*              saknade vrden, som avbrott i en inspelning.
+*
+*              - v      : Pekare till frsta vrdet.
+*              - n      : Antal vrden.
+*              - threads: Antal trdar.
+********************************************************************************/
+static void fill_series(int16_t* v, const size_t n, const unsigned threads)
+{
+   std::vector<std::thread> pool;
+
+   for (unsigned part = 0; part < threads; ++part)
+   {
+      pool.emplace_back([=]()
+      {
+         const size_t begin = n * part / threads;
+         const size_t end = n * (part + 1) / threads;
+         uint32_t rng = 12345 + part;
+         int16_t code = 153;
+
+         for (size_t i = begin; i < end; ++i)
+         {
+            rng = rng * 1103515245 + 12345;
+            const int step = (int)((rng >> 16) % 3) - 1;
+            if (code + step >= 100 && code + step <= 250) code = (int16_t)(code + step);
+            v[i] = i % BENCH_HOLE_EVERY < BENCH_HOLE_LEN ? SERIES_MISSING : code;
+         }
+      });
+   }
+
+   for (std::thread& t : pool)
+   {
+      t.join();
+   }
+
+   return;
+}
+
+/********************************************************************************
+* report: Skriver ut genomstrmningen fr ett moment.
+********************************************************************************/
+static void report(const char* what, const size_t n, const double seconds)
+{
+   printf("%-34s %8.3f s  %7.2f Gvrden/s  %7.2f GB/s\n",
+          what, seconds, n / seconds / 1e9, n * sizeof(int16_t) / seconds / 1e9);
+   return;
+}
+
+/********************************************************************************
+* same_stats: Indikerar ifall tv resultat r identiska.
+********************************************************************************/
+static bool same_stats(const struct series_stats& a, const struct series_stats& b)
+{
+   return a.min == b.min && a.max == b.max && a.sum == b.sum && a.count == b.count;
+}
+
+/********************************************************************************
+* expected_centi: Returnerar det vrde som series_codes_to_centi ska ge fr
+*                 angivet AD-resultat enligt dess dokumentation, berknat
+*                 med den skalra referensen tmp36_code_to_centi.
+*
+*                 - code: AD-resultat eller SERIES_MISSING.
+********************************************************************************/
+static int16_t expected_centi(const uint16_t code)
+{
+   if ((int16_t)code == SERIES_MISSING) return SERIES_MISSING;
+   const int32_t centi = tmp36_code_to_centi(code < (uint16_t)TMP36_ADC_MAX ? code : (uint16_t)TMP36_ADC_MAX);
+   return (int16_t)(centi < SERIES_VALUE_MAX ? centi : SERIES_VALUE_MAX);
+}
+
+/********************************************************************************
+* main: Skapar eller teranvnder seriefilen och mter range-aggregat per
+*       instruktionsuppsttning, flertrdade aggregat, nedsampling, LTTB samt
+*       omvandling frn AD-resultat. Resultaten frn alla varianter jmfrs
+*       med den skalra referensen.
+********************************************************************************/
+int main(int argc, char** argv)
+{
+   size_t n = 1000000000;
+   unsigned threads = std::thread::hardware_concurrency();
+   const char* path = "/tmp/bench_query.ser";
+   bool keep = false;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:t:f:k")) != -1)
+   {
+      switch (opt)
+      {
+      case 'n': n = strtoull(optarg, nullptr, 10); break;
+      case 't': threads = (unsigned)strtoul(optarg, nullptr, 10); break;
+      case 'f': path = optarg; break;
+      case 'k': keep = true; break;
+      default: optind = argc + 1; break;
+      }
+   }
+
+   if (optind != argc || n < BENCH_LTTB_POINTS)
+   {
+      fprintf(stderr, "Anvndning: %s [-n antal] [-t trdar] [-f fil] [-k]\n", argv[0]);
+      return 2;
+   }
+
+   if (threads == 0) threads = 1;
+   series_file file;
+   double start = seconds_now();
+
+   if (keep && access(path, R_OK) == 0 && file.open(path) && file.count() == n && file.kind() == SAMPLE_RAW_ADC)
+   {
+      printf("teranvnder %s\n", path);
+   }
+   else
+   {
+      series_file writer;
+      if (!writer.create(path, SAMPLE_RAW_ADC, n, 0, 60000000000LL)) return 1;
+      fill_series(writer.writable_values(), n, threads);
+      writer.close();
+      if (!file.open(path)) return 1;
+      report("Generering", n, seconds_now() - start);
+   }
+
+   const int16_t* v = file.values();
+   const enum series_isa best = series_best_isa();
+   printf("%zu vrden, %u trdar, bsta instruktionsuppsttning: %s\n", n, threads, series_isa_name(best));
+
+   (void)series_range_stats(v, n, threads, best);
+   bool ok = true;
+   struct series_stats reference = { 0, 0, 0, 0 };
+
+   for (int isa = SERIES_ISA_SCALAR; isa <= (int)best; ++isa)
+   {
+      char what[64];
+      snprintf(what, sizeof(what), "Min/max/medel, %s, 1 trd", series_isa_name((enum series_isa)isa));
+      start = seconds_now();
+      const struct series_stats s = series_range_stats(v, n, 1, (enum series_isa)isa);
+      report(what, n, seconds_now() - start);
+
+      if (isa == SERIES_ISA_SCALAR) reference = s;
+      ok = ok && same_stats(s, reference);
+   }
+
+   char what[64];
+   snprintf(what, sizeof(what), "Min/max/medel, %s, %u trdar", series_isa_name(best), threads);
+   start = seconds_now();
+   const struct series_stats all = series_range_stats(v, n, threads, best);
+   report(what, n, seconds_now() - start);
+   ok = ok && same_stats(all, reference);
+
+   printf("  min %.2f, max %.2f, medel %.3f grader Celcius\n",
+          series_to_celcius(file.kind(), all.min), series_to_celcius(file.kind(), all.max),
+          series_to_celcius(file.kind(), (double)all.sum / all.count));
+
+   const size_t bucket_len = (n + BENCH_BUCKETS - 1) / BENCH_BUCKETS;
+   std::vector<struct series_stats> buckets((n + bucket_len - 1) / bucket_len);
+   start = seconds_now();
+   series_downsample(v, n, bucket_len, buckets.data(), threads, best);
+   report("Nedsampling till 1000 hinkar", n, seconds_now() - start);
+
+   int64_t bucket_sum = 0;
+   for (const struct series_stats& b : buckets) bucket_sum += b.sum;
+   ok = ok && bucket_sum == reference.sum;
+
+   std::vector<uint64_t> lttb_scalar(BENCH_LTTB_POINTS);
+   std::vector<uint64_t> lttb_best(BENCH_LTTB_POINTS);
+   start = seconds_now();
+   series_lttb(v, n, BENCH_LTTB_POINTS, lttb_scalar.data(), 1, SERIES_ISA_SCALAR);
+   report("LTTB till 2000 punkter, skalr", n, seconds_now() - start);
+
+   snprintf(what, sizeof(what), "LTTB till 2000 punkter, %s", series_isa_name(best));
+   start = seconds_now();
+   series_lttb(v, n, BENCH_LTTB_POINTS, lttb_best.data(), threads, best);
+   report(what, n, seconds_now() - start);
+   ok = ok && lttb_scalar == lttb_best;
+
+   const size_t convert = n < BENCH_CONVERT_MAX ? n : BENCH_CONVERT_MAX;
+   std::vector<int16_t> centi(convert);
+   start = seconds_now();
+   series_codes_to_centi((const uint16_t*)v, centi.data(), convert, threads);
+   report("Omvandling till centigrader", convert, seconds_now() - start);
+
+   for (size_t i = 0; ok && i < convert; ++i)
+   {
+      ok = centi[i] == expected_centi((uint16_t)v[i]);
+   }
+
+   file.close();
+   if (!keep) unlink(path);
+
+   if (!ok)
+   {
+      fprintf(stderr, "Fel: varianterna gav olika resultat!\n");
+      return 1;
+   }
+
+   return 0;
+}
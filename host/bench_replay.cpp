@@ -0,0 +1,292 @@
+/********************************************************************************
+* bench_replay.cpp: Prestandamtning av insamlingskedjan. En inspelad strm
+*                   (eller en syntetisk strm i mikrodatorns utskriftsformat)
+*                   spelas upp s snabbt som mjligt genom stream_parser och
+*                   column_store, och genomstrmningen jmfrs med realtid.
+*                   Drefter kontrolleras att strmmen ger samma poster nr
+*                   den lses i slumpmssigt stora block som i ett enda.
+*
+*                   Anvndning:
+*
+*                   bench_replay [-n rader] [-c blockstorlek] [-m k] [-e j] [inspelning]
+*
+*                   - rader       : Antal syntetiska rader, frvalt 10 000 000.
+*                   - blockstorlek: Antal byte per lsning, frvalt 4096.
+*                   - k           : Var k:e post skickas som binr ram.
+*                   - j           : Var j:e post fregs av en skrpbyte (brus).
+*                   - inspelning  : Fil med inspelad strm, erstter syntetisk data.
+********************************************************************************/
+#include "column_store.h"
+#include "stream_parser.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+/* Makrodefinitioner: */
+#define BENCH_SYNC_ROWS 100000 /* Bekrfta efter s hr mnga rader, som i collector. */
+#define SERIAL_BYTES_PER_S 960 /* 9600 baud med tio bitar per tecken. */
+#define NOISE_BYTE 0x00        /* Skrpbyte som lggs in fre brusiga poster. */
+
+/********************************************************************************
+* seconds_now: Returnerar monoton tid i sekunder.
+********************************************************************************/
+static double seconds_now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/********************************************************************************
+* generate_stream: Skapar en syntetisk strm med angivet antal poster. AD-
+*                  resultatet fljer en slumpvandring kring rumstemperatur.
+*                  En skrpbyte fre en ram ska verlevas genom omsynkning,
+*                  medan en textrad med skrp framfr kastas. Antalet
+*                  frvntade poster och summan av deras vrden lagras i
+*                  expected_rows respektive expected_sum.
+*
+*                  - lines        : Antal poster.
+*                  - frame_every  : Var k:e post skickas som binr ram (0 = aldrig).
+*                  - noise_every  : Var j:e post fregs av en skrpbyte (0 = aldrig).
+*                  - expected_rows: Lagringsplats fr antalet frvntade poster.
+*                  - expected_sum : Lagringsplats fr summan av frvntade vrden.
+********************************************************************************/
+static std::string generate_stream(const size_t lines, const size_t frame_every, const size_t noise_every,
+                                   size_t& expected_rows, int64_t& expected_sum)
+{
+   std::string stream;
+   stream.reserve(lines * 40);
+   uint16_t code = 153;
+   uint32_t rng = 12345;
+   expected_rows = 0;
+   expected_sum = 0;
+
+   for (size_t i = 0; i < lines; ++i)
+   {
+      rng = rng * 1103515245 + 12345;
+      const int step = (int)((rng >> 16) % 3) - 1;
+      if ((code > 0 || step > 0) && (code < 1023 || step < 0)) code = (uint16_t)(code + step);
+
+      const bool noisy = noise_every && i % noise_every == noise_every - 1;
+      if (noisy) stream.push_back((char)NOISE_BYTE);
+
+      if (frame_every && i % frame_every == 0)
+      {
+         uint8_t frame[FRAME_SIZE];
+         frame_encode(frame, 1, SAMPLE_RAW_ADC, (uint16_t)i, (int16_t)code);
+         stream.append((const char*)frame, sizeof(frame));
+         expected_sum += tmp36_code_to_centi(code);
+         ++expected_rows;
+      }
+      else
+      {
+         char line[RECORD_MAX_LEN];
+         int32_t value_centi = 0;
+         stream.append(line, format_line(line, tmp36_code_to_celcius(code), &value_centi));
+
+         if (!noisy)
+         {
+            expected_sum += value_centi;
+            ++expected_rows;
+         }
+      }
+   }
+
+   return stream;
+}
+
+/********************************************************************************
+* same_records: Indikerar ifall tv fljder av poster r identiska.
+********************************************************************************/
+static bool same_records(const std::vector<record>& a, const std::vector<record>& b)
+{
+   if (a.size() != b.size()) return false;
+
+   for (size_t i = 0; i < a.size(); ++i)
+   {
+      if (a[i].sensor != b[i].sensor || a[i].has_seq != b[i].has_seq ||
+          a[i].seq != b[i].seq || a[i].value_centi != b[i].value_centi)
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+/********************************************************************************
+* split_invariant: Tolkar strmmen dels i ett enda block, dels i block om
+*                  slumpmssigt 1 - RECORD_MAX_LEN byte, och indikerar ifall
+*                  bda ger samma poster och samma antal felaktiga poster.
+*                  Tolkningen fr inte bero p hur strmmen delas upp i
+*                  lsningar frn serieporten.
+*
+*                  - data: Pekare till strmmen.
+*                  - size: Strmmens storlek i byte.
+********************************************************************************/
+static bool split_invariant(const uint8_t* data, const size_t size)
+{
+   stream_parser whole;
+   stream_parser split;
+   std::vector<record> expected;
+   std::vector<record> actual;
+   uint32_t rng = 54321;
+
+   whole.feed(data, size, expected);
+
+   for (size_t offset = 0; offset < size;)
+   {
+      rng = rng * 1103515245 + 12345;
+      size_t n = 1 + (rng >> 16) % RECORD_MAX_LEN;
+      if (n > size - offset) n = size - offset;
+      split.feed(data + offset, n, actual);
+      offset += n;
+   }
+
+   return whole.bad_records == split.bad_records && same_records(expected, actual);
+}
+
+/********************************************************************************
+* main: Genererar eller mappar strmmen och spelar upp den i block om angiven
+*       storlek till en temporr kolumnfil.
+********************************************************************************/
+int main(int argc, char** argv)
+{
+   size_t lines = 10000000;
+   size_t chunk = 4096;
+   size_t frame_every = 0;
+   size_t noise_every = 0;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:c:m:e:")) != -1)
+   {
+      switch (opt)
+      {
+      case 'n': lines = strtoull(optarg, nullptr, 10); break;
+      case 'c': chunk = strtoull(optarg, nullptr, 10); break;
+      case 'm': frame_every = strtoull(optarg, nullptr, 10); break;
+      case 'e': noise_every = strtoull(optarg, nullptr, 10); break;
+      default: optind = argc + 1; break;
+      }
+   }
+
+   if (optind + 1 < argc || optind > argc || chunk == 0)
+   {
+      fprintf(stderr, "Anvndning: %s [-n rader] [-c blockstorlek] [-m k] [-e j] [inspelning]\n", argv[0]);
+      return 2;
+   }
+
+   std::string generated;
+   const uint8_t* data = nullptr;
+   size_t size = 0;
+   size_t expected_rows = 0;
+   int64_t expected_sum = 0;
+   const bool replay = optind < argc;
+
+   if (replay)
+   {
+      const int fd = open(argv[optind], O_RDONLY);
+      struct stat st;
+
+      if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+      {
+         fprintf(stderr, "%s: Kunde inte ppna inspelningen!\n", argv[optind]);
+         return 1;
+      }
+
+      size = (size_t)st.st_size;
+      data = (const uint8_t*)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+
+      if (data == MAP_FAILED)
+      {
+         perror("mmap");
+         return 1;
+      }
+   }
+   else
+   {
+      generated = generate_stream(lines, frame_every, noise_every, expected_rows, expected_sum);
+      data = (const uint8_t*)generated.data();
+      size = generated.size();
+   }
+
+   char path[] = "/tmp/bench_replay_XXXXXX";
+   const int tmp_fd = mkstemp(path);
+
+   if (tmp_fd < 0)
+   {
+      perror("mkstemp");
+      return 1;
+   }
+
+   close(tmp_fd);
+   column_store store;
+
+   if (!store.open(path, true))
+   {
+      unlink(path);
+      return 1;
+   }
+
+   stream_parser parser;
+   std::vector<record> records;
+   int64_t sum = 0;
+   int64_t timestamp = 0;
+   const double start = seconds_now();
+
+   for (size_t offset = 0; offset < size; offset += chunk)
+   {
+      const size_t n = size - offset < chunk ? size - offset : chunk;
+      records.clear();
+      parser.feed(data + offset, n, records);
+      ++timestamp;
+
+      for (const record& r : records)
+      {
+         store.append(timestamp, r.sensor, r.value_centi);
+         sum += r.value_centi;
+      }
+
+      if (store.rows() - store.committed_rows() >= BENCH_SYNC_ROWS) store.sync();
+   }
+
+   store.sync();
+   const double elapsed = seconds_now() - start;
+   const double rows = (double)store.rows();
+   const double rows_per_s = rows / elapsed;
+   const double line_bytes = rows > 0 ? size / rows : 1;
+
+   printf("%.0f poster (%.1f MB) p %.3f s: %.2f Mposter/s, %.1f MB/s\n",
+          rows, size / 1e6, elapsed, rows_per_s / 1e6, size / 1e6 / elapsed);
+   printf("Felaktiga poster: %llu, kastade byte: %llu\n",
+          (unsigned long long)parser.bad_records, (unsigned long long)parser.dropped_bytes);
+   printf("Realtidsfaktor mot mttad 9600 baud-lnk: %.0fx\n",
+          rows_per_s / (SERIAL_BYTES_PER_S / line_bytes));
+   printf("Motsvarar %.0f kort som skriver ut en gng per minut\n", rows_per_s * (TMP36_PRINT_PERIOD_MS / 1000.0));
+
+   store.close();
+   unlink(path);
+
+   if (!replay && (rows != (double)expected_rows || sum != expected_sum))
+   {
+      fprintf(stderr, "Fel: tolkade vrden stmmer inte med den genererade strmmen!\n");
+      return 1;
+   }
+
+   if (!split_invariant(data, size))
+   {
+      fprintf(stderr, "Fel: tolkningen beror p blockstorleken!\n");
+      return 1;
+   }
+
+   return 0;
+}
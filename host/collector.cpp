@@ -0,0 +1,185 @@
+/********************************************************************************
+* collector.cpp: Insamlingsprogram som lser temperaturutskrifter frn en
+*                seriell port, pseudoterminal eller fil och lagrar dem i en
+*                kolumnfil (se column_store.h).
+*
+*                Anvndning:
+*
+*                collector [-s sensor] [-b baud] [-i sync_ms] [-f] <klla> <fil>
+*
+*                - klla  : Seriell port, pseudoterminal, fil eller "-" fr stdin.
+*                - fil    : Kolumnfilen som posterna lggs till i.
+*                - sensor : Sensor-id fr textrader (binra ramar br eget id).
+*                - baud   : Baud rate fr seriella portar, frvalt 9600 som i
+*                           tmp36_init.
+*                - sync_ms: Intervall mellan bekrftelser till disk i ms.
+*                - f      : Fortstt lsa nr slutet av en vanlig fil ns.
+********************************************************************************/
+#include "column_store.h"
+#include "stream_parser.h"
+#include "tty.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Makrodefinitioner: */
+#define READ_BUFFER_SIZE 65536 /* Storlek p lsbufferten i byte. */
+#define SYNC_MAX_ROWS 100000   /* Bekrfta senast efter s hr mnga rader. */
+
+/* Stts av signalhanteraren nr programmet ska avslutas. */
+static volatile sig_atomic_t stop_requested = 0;
+
+/********************************************************************************
+* on_signal: Signalhanterare fr SIGINT och SIGTERM.
+********************************************************************************/
+static void on_signal(int)
+{
+   stop_requested = 1;
+   return;
+}
+
+/********************************************************************************
+* now_ns: Returnerar aktuell tid i nanosekunder sedan epoken.
+********************************************************************************/
+static int64_t now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_REALTIME, &ts);
+   return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/********************************************************************************
+* main: Lser kllan i block om READ_BUFFER_SIZE byte, tolkar blocken direkt i
+*       lsbufferten och lgger till posterna i kolumnfilen. Alla poster i
+*       samma block fr blockets mottagningstid som tidsstmpel. Filen
+*       bekrftas var sync_ms:e millisekund, efter SYNC_MAX_ROWS rader samt
+*       vid avslut.
+********************************************************************************/
+int main(int argc, char** argv)
+{
+   long sensor = 0;
+   long baud = 9600;
+   long sync_ms = 1000;
+   bool follow = false;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "s:b:i:f")) != -1)
+   {
+      switch (opt)
+      {
+      case 's': sensor = strtol(optarg, nullptr, 10); break;
+      case 'b': baud = strtol(optarg, nullptr, 10); break;
+      case 'i': sync_ms = strtol(optarg, nullptr, 10); break;
+      case 'f': follow = true; break;
+      default: optind = argc + 1; break;
+      }
+   }
+
+   if (optind + 2 != argc || sensor < 0 || sensor > 0xFFFF || sync_ms <= 0 || tty_baud_to_speed(baud) == B0)
+   {
+      fprintf(stderr, "Anvndning: %s [-s sensor] [-b baud] [-i sync_ms] [-f] <klla> <fil>\n", argv[0]);
+      return 2;
+   }
+
+   const char* source = argv[optind];
+   const int fd = strcmp(source, "-") == 0 ? STDIN_FILENO : open(source, O_RDONLY | O_NOCTTY | O_CLOEXEC);
+
+   if (fd < 0)
+   {
+      fprintf(stderr, "%s: %s\n", source, strerror(errno));
+      return 1;
+   }
+
+   const bool is_tty = isatty(fd);
+
+   if (is_tty && !tty_configure_raw(fd, tty_baud_to_speed(baud)))
+   {
+      fprintf(stderr, "%s: %s\n", source, strerror(errno));
+      return 1;
+   }
+
+   column_store store;
+   if (!store.open(argv[optind + 1], true)) return 1;
+
+   struct sigaction sa;
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = on_signal;
+   sigaction(SIGINT, &sa, nullptr);
+   sigaction(SIGTERM, &sa, nullptr);
+
+   static uint8_t buffer[READ_BUFFER_SIZE];
+   std::vector<record> records;
+   stream_parser parser;
+   const uint64_t rows_at_start = store.rows();
+   int64_t next_sync = now_ns() + sync_ms * 1000000LL;
+   bool ok = true;
+
+   while (!stop_requested && ok)
+   {
+      int64_t now = now_ns();
+      struct pollfd pfd = { fd, POLLIN, 0 };
+      const int timeout_ms = next_sync > now ? (int)((next_sync - now) / 1000000LL) + 1 : 0;
+      const int ready = poll(&pfd, 1, timeout_ms);
+
+      if (ready > 0)
+      {
+         const ssize_t n = read(fd, buffer, sizeof(buffer));
+
+         if (n > 0)
+         {
+            const int64_t timestamp = now_ns();
+            records.clear();
+            parser.feed(buffer, (size_t)n, records);
+
+            for (const record& r : records)
+            {
+               const uint16_t id = r.has_seq ? r.sensor : (uint16_t)sensor;
+
+               if (!store.append(timestamp, id, r.value_centi))
+               {
+                  ok = false;
+                  break;
+               }
+            }
+         }
+         else if (n == 0 && !is_tty && follow)
+         {
+            usleep(100000);
+         }
+         else if (n == 0 || (errno != EINTR && errno != EAGAIN))
+         {
+            if (n < 0 && errno != EIO) fprintf(stderr, "%s: %s\n", source, strerror(errno));
+            break;
+         }
+      }
+      else if (ready < 0 && errno != EINTR)
+      {
+         fprintf(stderr, "poll: %s\n", strerror(errno));
+         break;
+      }
+
+      now = now_ns();
+
+      if (now >= next_sync || store.rows() - store.committed_rows() >= SYNC_MAX_ROWS)
+      {
+         ok = ok && store.sync();
+         next_sync = now + sync_ms * 1000000LL;
+      }
+   }
+
+   ok = store.sync() && ok;
+   fprintf(stderr, "%llu poster lagrade, %llu felaktiga poster, %llu kastade byte.\n",
+           (unsigned long long)(store.rows() - rows_at_start),
+           (unsigned long long)parser.bad_records,
+           (unsigned long long)parser.dropped_bytes);
+
+   if (fd != STDIN_FILENO) close(fd);
+   return ok ? 0 : 1;
+}
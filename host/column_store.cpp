@@ -0,0 +1,393 @@
+/********************************************************************************
+* column_store.cpp: Innehller definitioner fr den minnesmappade
+*                   kolumnlagringen.
+********************************************************************************/
+#include "column_store.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Makrodefinitioner: */
+#define COLUMN_STORE_MAGIC "TMPCOL01" /* Identifierar filformatet. */
+#define COLUMN_STORE_VERSION 1        /* Filformatets version. */
+#define COLUMN_STORE_SLOT_SIZE 2048   /* Avstnd mellan huvudets tv platser. */
+#define COLUMN_STORE_MAX_GROWTH 64    /* Hgst antal block som lggs till t gngen. */
+
+/********************************************************************************
+* header_slot: En av huvudets tv platser.
+********************************************************************************/
+struct header_slot
+{
+   char magic[8];           /* COLUMN_STORE_MAGIC utan nolltecken. */
+   uint32_t version;        /* COLUMN_STORE_VERSION. */
+   uint32_t block_rows;     /* Antal rader per block. */
+   uint64_t generation;     /* kar med ett fr varje bekrftelse. */
+   uint64_t committed_rows; /* Antal rader som r bestndiga. */
+   uint64_t checksum;       /* FNV-1a ver fregende flt. */
+};
+
+/********************************************************************************
+* slot_checksum: Returnerar kontrollsumman (FNV-1a, 64 bitar) fr angiven
+*                plats, berknad ver alla flt fre sjlva kontrollsumman.
+********************************************************************************/
+static uint64_t slot_checksum(const header_slot& slot)
+{
+   const uint8_t* p = (const uint8_t*)&slot;
+   uint64_t hash = 14695981039346656037ULL;
+
+   for (size_t i = 0; i < offsetof(header_slot, checksum); ++i)
+   {
+      hash = (hash ^ p[i]) * 1099511628211ULL;
+   }
+
+   return hash;
+}
+
+/********************************************************************************
+* slot_is_valid: Indikerar ifall angiven plats r en giltig och oskadad
+*                huvudplats.
+********************************************************************************/
+static bool slot_is_valid(const header_slot& slot)
+{
+   return memcmp(slot.magic, COLUMN_STORE_MAGIC, sizeof(slot.magic)) == 0 &&
+      slot.version == COLUMN_STORE_VERSION &&
+      slot.block_rows > 0 && slot.block_rows % COLUMN_STORE_ROW_ALIGN == 0 &&
+      slot.checksum == slot_checksum(slot);
+}
+
+/********************************************************************************
+* flush_range: Skriver angivet intervall av mappningen till disk. Startadressen
+*              avrundas nedt till nrmaste sidgrns.
+*
+*              - base : Kolumnens startadress (sidjusterad).
+*              - begin: Frsta byte att skriva, relativt base.
+*              - end  : Byte efter sista byte att skriva, relativt base.
+********************************************************************************/
+static bool flush_range(uint8_t* base, const size_t begin, const size_t end)
+{
+   static const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+   const size_t aligned = begin & ~(page_size - 1);
+   return msync(base + aligned, end - aligned, MS_SYNC) == 0;
+}
+
+/********************************************************************************
+* open: ppnar eller skapar angiven fil.
+*
+*       0. Vid skrivning tas ett exklusivt ls p filen, eftersom endast en
+*          skrivande process stds. Innehas lset redan av en annan process
+*          misslyckas ppningen. Lset slpps nr filen stngs.
+*
+*       1. En tom fil initieras med ett huvud utan rader. Endast ett huvud
+*          skrivs till disk, filen utkas frst nr frsta raden lggs till.
+*
+*       2. Fr en befintlig fil vljs den giltiga huvudplatsen med hgst
+*          generationsnummer. Ett ofullstndigt block i slutet av filen
+*          (frn en avbruten utkning) ignoreras och trunkeras bort om
+*          filen ppnas fr skrivning.
+*
+*       3. Hela filen mappas. Rader efter det bekrftade antalet rknas inte
+*          och skrivs ver av kommande anrop av append.
+*
+*       - path      : Skvg till filen.
+*       - writable  : Indikerar ifall filen ska ppnas fr skrivning.
+*       - block_rows: Antal rader per block (anvnds endast vid skapande).
+********************************************************************************/
+bool column_store::open(const char* path, const bool writable, const uint32_t block_rows)
+{
+   close();
+
+   fd_ = ::open(path, writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+   if (fd_ < 0)
+   {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      return false;
+   }
+
+   if (writable && flock(fd_, LOCK_EX | LOCK_NB) != 0)
+   {
+      if (errno == EWOULDBLOCK)
+      {
+         fprintf(stderr, "%s: Filen skrivs redan av en annan process!\n", path);
+      }
+      else
+      {
+         fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      }
+
+      close();
+      return false;
+   }
+
+   struct stat st;
+   if (fstat(fd_, &st) != 0)
+   {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      close();
+      return false;
+   }
+
+   writable_ = writable;
+   size_t file_size = (size_t)st.st_size;
+
+   if (file_size == 0)
+   {
+      if (!writable || block_rows == 0 || block_rows % COLUMN_STORE_ROW_ALIGN != 0)
+      {
+         fprintf(stderr, "%s: Tom fil eller ogiltigt antal rader per block!\n", path);
+         close();
+         return false;
+      }
+
+      if (ftruncate(fd_, COLUMN_STORE_HEADER_SIZE) != 0)
+      {
+         fprintf(stderr, "%s: %s\n", path, strerror(errno));
+         close();
+         return false;
+      }
+
+      block_rows_ = block_rows;
+      file_size = COLUMN_STORE_HEADER_SIZE;
+   }
+   else
+   {
+      header_slot slots[2];
+      const header_slot* best = nullptr;
+
+      for (int i = 0; i < 2; ++i)
+      {
+         if (pread(fd_, &slots[i], sizeof(slots[i]), i * COLUMN_STORE_SLOT_SIZE) == sizeof(slots[i]) &&
+             slot_is_valid(slots[i]) && (!best || slots[i].generation > best->generation))
+         {
+            best = &slots[i];
+         }
+      }
+
+      if (!best || file_size < COLUMN_STORE_HEADER_SIZE)
+      {
+         fprintf(stderr, "%s: Inget giltigt huvud hittades!\n", path);
+         close();
+         return false;
+      }
+
+      block_rows_ = best->block_rows;
+      generation_ = best->generation;
+      committed_rows_ = best->committed_rows;
+      rows_ = committed_rows_;
+
+      const size_t blocks = (file_size - COLUMN_STORE_HEADER_SIZE) / block_bytes();
+      if (committed_rows_ > (uint64_t)blocks * block_rows_)
+      {
+         fprintf(stderr, "%s: Filen r kortare n antalet bekrftade rader!\n", path);
+         close();
+         return false;
+      }
+
+      file_size = COLUMN_STORE_HEADER_SIZE + blocks * block_bytes();
+      if (writable && file_size != (size_t)st.st_size && ftruncate(fd_, (off_t)file_size) != 0)
+      {
+         fprintf(stderr, "%s: %s\n", path, strerror(errno));
+         close();
+         return false;
+      }
+   }
+
+   const int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+   void* map = mmap(nullptr, file_size, prot, MAP_SHARED, fd_, 0);
+
+   if (map == MAP_FAILED)
+   {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      close();
+      return false;
+   }
+
+   map_ = (uint8_t*)map;
+   map_size_ = file_size;
+   mapped_blocks_ = (file_size - COLUMN_STORE_HEADER_SIZE) / block_bytes();
+
+   if (writable && generation_ == 0 && !write_header())
+   {
+      close();
+      return false;
+   }
+
+   return true;
+}
+
+/********************************************************************************
+* close: Bekrftar eventuella skrivna rader och stnger filen.
+********************************************************************************/
+void column_store::close(void)
+{
+   if (map_)
+   {
+      if (writable_) (void)sync();
+      munmap(map_, map_size_);
+   }
+
+   if (fd_ >= 0) ::close(fd_);
+
+   fd_ = -1;
+   writable_ = false;
+   map_ = nullptr;
+   map_size_ = 0;
+   mapped_blocks_ = 0;
+   block_rows_ = 0;
+   rows_ = 0;
+   committed_rows_ = 0;
+   generation_ = 0;
+   return;
+}
+
+/********************************************************************************
+* grow: Utkar filen och mappningen. Antalet block frdubblas, dock med hgst
+*       COLUMN_STORE_MAX_GROWTH block t gngen. Utrymmet reserveras med
+*       posix_fallocate s att en full disk ger ett fel hr i stllet fr
+*       SIGBUS vid skrivning i mappningen.
+********************************************************************************/
+bool column_store::grow(void)
+{
+   size_t added = mapped_blocks_ > 0 ? mapped_blocks_ : 1;
+   if (added > COLUMN_STORE_MAX_GROWTH) added = COLUMN_STORE_MAX_GROWTH;
+
+   const size_t new_size = map_size_ + added * block_bytes();
+   const int err = posix_fallocate(fd_, (off_t)map_size_, (off_t)(new_size - map_size_));
+
+   if (err != 0)
+   {
+      fprintf(stderr, "column_store: %s\n", strerror(err));
+      return false;
+   }
+
+   void* map = mremap(map_, map_size_, new_size, MREMAP_MAYMOVE);
+
+   if (map == MAP_FAILED)
+   {
+      fprintf(stderr, "column_store: %s\n", strerror(errno));
+      return false;
+   }
+
+   map_ = (uint8_t*)map;
+   map_size_ = new_size;
+   mapped_blocks_ += added;
+   return true;
+}
+
+/********************************************************************************
+* append: Lgger till en rad sist i filen.
+*
+*         - timestamp_ns: Tidsstmpel i nanosekunder sedan epoken.
+*         - sensor      : Sensor-id.
+*         - value_centi : Temperaturen i hundradels grader Celcius.
+********************************************************************************/
+bool column_store::append(const int64_t timestamp_ns, const uint16_t sensor, const int32_t value_centi)
+{
+   if (!writable_) return false;
+   if (rows_ == (uint64_t)mapped_blocks_ * block_rows_ && !grow()) return false;
+
+   const size_t block = (size_t)(rows_ / block_rows_);
+   const uint32_t index = (uint32_t)(rows_ % block_rows_);
+   uint8_t* base = block_base(block);
+
+   ((int64_t*)base)[index] = timestamp_ns;
+   ((int32_t*)(base + 8UL * block_rows_))[index] = value_centi;
+   ((uint16_t*)(base + 12UL * block_rows_))[index] = sensor;
+   ++rows_;
+   return true;
+}
+
+/********************************************************************************
+* sync: Skriver tillagda rader till disk och bekrftar dem i huvudet.
+*
+*       1. Varje kolumns obekrftade intervall skrivs till disk med msync.
+*
+*       2. fdatasync anropas s att en eventuell ny filstorlek blir bestndig.
+*
+*       3. Frst drefter skrivs huvudet med det nya antalet rader, s att
+*          huvudet aldrig pekar p data som inte finns p disk.
+********************************************************************************/
+bool column_store::sync(void)
+{
+   if (!writable_) return false;
+   if (rows_ == committed_rows_) return true;
+
+   for (uint64_t row = committed_rows_; row < rows_;)
+   {
+      const size_t block = (size_t)(row / block_rows_);
+      const size_t first = (size_t)(row % block_rows_);
+      const size_t last = (rows_ - row < block_rows_ - first) ? first + (size_t)(rows_ - row) : block_rows_;
+      uint8_t* base = block_base(block);
+
+      if (!flush_range(base, first * 8, last * 8) ||
+          !flush_range(base + 8UL * block_rows_, first * 4, last * 4) ||
+          !flush_range(base + 12UL * block_rows_, first * 2, last * 2))
+      {
+         fprintf(stderr, "column_store: %s\n", strerror(errno));
+         return false;
+      }
+
+      row += last - first;
+   }
+
+   if (fdatasync(fd_) != 0)
+   {
+      fprintf(stderr, "column_store: %s\n", strerror(errno));
+      return false;
+   }
+
+   const uint64_t previous = committed_rows_;
+   committed_rows_ = rows_;
+
+   if (!write_header())
+   {
+      committed_rows_ = previous;
+      return false;
+   }
+
+   return true;
+}
+
+/********************************************************************************
+* write_header: Skriver den ldre av huvudets tv platser med nsta
+*               generationsnummer och aktuellt antal bekrftade rader.
+********************************************************************************/
+bool column_store::write_header(void)
+{
+   header_slot slot;
+   memset(&slot, 0, sizeof(slot));
+   memcpy(slot.magic, COLUMN_STORE_MAGIC, sizeof(slot.magic));
+   slot.version = COLUMN_STORE_VERSION;
+   slot.block_rows = block_rows_;
+   slot.generation = generation_ + 1;
+   slot.committed_rows = committed_rows_;
+   slot.checksum = slot_checksum(slot);
+
+   memcpy(map_ + (slot.generation % 2) * COLUMN_STORE_SLOT_SIZE, &slot, sizeof(slot));
+
+   if (msync(map_, COLUMN_STORE_HEADER_SIZE, MS_SYNC) != 0)
+   {
+      fprintf(stderr, "column_store: %s\n", strerror(errno));
+      return false;
+   }
+
+   generation_ = slot.generation;
+   return true;
+}
+
+/********************************************************************************
+* block_length: Returnerar antalet anvnda rader i angivet block.
+*
+*               - block: Blockets index.
+********************************************************************************/
+uint32_t column_store::block_length(const size_t block) const
+{
+   const uint64_t start = (uint64_t)block * block_rows_;
+   if (start >= rows_) return 0;
+   return rows_ - start < block_rows_ ? (uint32_t)(rows_ - start) : block_rows_;
+}
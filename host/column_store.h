@@ -0,0 +1,109 @@
+/********************************************************************************
+* column_store.h: Kolumnorienterad tidsserielagring i en minnesmappad fil.
+*
+*                 Filen bestr av ett huvud om COLUMN_STORE_HEADER_SIZE byte
+*                 fljt av block med plats fr block_rows rader vardera.
+*                 Varje block lagrar kolumnerna efter varandra:
+*
+*                 [tidsstmplar, int64][vrden, int32][sensor-id, uint16],
+*
+*                 s att en kolumn i ett block alltid r sammanhngande och
+*                 sidjusterad. Filen vxer med hela block och befintliga
+*                 block flyttas aldrig.
+*
+*                 Huvudet innehller tv platser som skrivs vxelvis, var och
+*                 en med generationsnummer, antal bekrftade rader och en
+*                 kontrollsumma. Vid sync skrivs frst data till disk och
+*                 drefter den ldre platsen. Avbryts skrivningen av ett
+*                 krasch r den andra platsen fortfarande giltig, och rader
+*                 efter senast bekrftade antal ignoreras vid ppning.
+********************************************************************************/
+#ifndef COLUMN_STORE_H_
+#define COLUMN_STORE_H_
+
+/* Inkluderingsdirektiv: */
+#include <stddef.h>
+#include <stdint.h>
+
+/* Makrodefinitioner: */
+#define COLUMN_STORE_HEADER_SIZE 4096  /* Huvudets storlek i byte (en sida). */
+#define COLUMN_STORE_BLOCK_ROWS 65536  /* Frvalt antal rader per block. */
+#define COLUMN_STORE_ROW_ALIGN 2048    /* block_rows mste vara en multipel av detta. */
+
+/********************************************************************************
+* column_store: Minnesmappad kolumnfil med tidsstmpel, sensor-id och vrde
+*               per rad. Endast en skrivande process t gngen stds, vilket
+*               upprtthlls med ett fills (se open).
+********************************************************************************/
+class column_store
+{
+public:
+   column_store(void) = default;
+   column_store(const column_store&) = delete;
+   column_store& operator=(const column_store&) = delete;
+   ~column_store(void) { close(); }
+
+   /********************************************************************************
+   * open: ppnar eller skapar angiven fil. Returnerar false vid fel, varvid
+   *       ett felmeddelande skrivs till stderr.
+   *
+   *       - path      : Skvg till filen.
+   *       - writable  : Indikerar ifall filen ska ppnas fr skrivning.
+   *       - block_rows: Antal rader per block (anvnds endast vid skapande).
+   ********************************************************************************/
+   bool open(const char* path,
+             const bool writable,
+             const uint32_t block_rows = COLUMN_STORE_BLOCK_ROWS);
+
+   /********************************************************************************
+   * close: Bekrftar eventuella skrivna rader och stnger filen.
+   ********************************************************************************/
+   void close(void);
+
+   /********************************************************************************
+   * append: Lgger till en rad. Raden r inte bestndig frrn sync anropats.
+   *         Returnerar false ifall filen inte gick att utka.
+   *
+   *         - timestamp_ns: Tidsstmpel i nanosekunder sedan epoken.
+   *         - sensor      : Sensor-id.
+   *         - value_centi : Temperaturen i hundradels grader Celcius.
+   ********************************************************************************/
+   bool append(const int64_t timestamp_ns, const uint16_t sensor, const int32_t value_centi);
+
+   /********************************************************************************
+   * sync: Skriver tillagda rader till disk och bekrftar dem i huvudet.
+   ********************************************************************************/
+   bool sync(void);
+
+   uint64_t rows(void) const { return rows_; }
+   uint64_t committed_rows(void) const { return committed_rows_; }
+   uint32_t block_rows(void) const { return block_rows_; }
+   size_t block_count(void) const { return (size_t)((rows_ + block_rows_ - 1) / block_rows_); }
+
+   /********************************************************************************
+   * block_length: Returnerar antalet anvnda rader i angivet block.
+   ********************************************************************************/
+   uint32_t block_length(const size_t block) const;
+
+   const int64_t* timestamps(const size_t block) const { return (const int64_t*)block_base(block); }
+   const int32_t* values(const size_t block) const { return (const int32_t*)(block_base(block) + 8UL * block_rows_); }
+   const uint16_t* sensors(const size_t block) const { return (const uint16_t*)(block_base(block) + 12UL * block_rows_); }
+
+private:
+   uint8_t* block_base(const size_t block) const { return map_ + COLUMN_STORE_HEADER_SIZE + block * block_bytes(); }
+   size_t block_bytes(void) const { return 14UL * block_rows_; }
+   bool grow(void);
+   bool write_header(void);
+
+   int fd_ = -1;                 /* Filbeskrivare, -1 d ingen fil r ppen. */
+   bool writable_ = false;       /* Indikerar ifall filen r ppnad fr skrivning. */
+   uint8_t* map_ = nullptr;      /* Mappning av hela filen. */
+   size_t map_size_ = 0;         /* Mappningens storlek i byte. */
+   size_t mapped_blocks_ = 0;    /* Antal block som ryms i mappningen. */
+   uint32_t block_rows_ = 0;     /* Antal rader per block. */
+   uint64_t rows_ = 0;           /* Antal tillagda rader. */
+   uint64_t committed_rows_ = 0; /* Antal rader som r bekrftade p disk. */
+   uint64_t generation_ = 0;     /* Generationsnummer fr senast skrivna huvudplats. */
+};
+
+#endif /* COLUMN_STORE_H_ */
@@ -0,0 +1,488 @@
+/********************************************************************************
+* device_mux.cpp: Innehller definitioner fr multiplexering av seriella
+*                 enheter med epoll.
+********************************************************************************/
+#include "device_mux.h"
+#include "tty.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Makrodefinitioner: */
+#define OUTPUT_ID 0xFFFFFFFFU /* Epoll-data som identifierar utgngen. */
+
+/********************************************************************************
+* now_ns: Returnerar aktuell tid i nanosekunder sedan epoken.
+********************************************************************************/
+static int64_t now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_REALTIME, &ts);
+   return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/********************************************************************************
+* ~device_mux: Stnger alla enheter, epoll-instansen samt utgngen ifall
+*              den ppnats av multiplexern.
+********************************************************************************/
+device_mux::~device_mux(void)
+{
+   for (device& dev : devices_)
+   {
+      if (dev.fd >= 0) close(dev.fd);
+   }
+
+   if (output_owned_) close(output_fd_);
+   if (epoll_fd_ >= 0) close(epoll_fd_);
+}
+
+/********************************************************************************
+* init: Skapar epoll-instansen och registrerar utgngen. Utgngen ppnas p
+*       nytt via /proc/self/fd med O_NONBLOCK, eftersom F_SETFL p output_fd
+*       skulle ndra den ppna filen som anroparen (och ofta stderr) delar,
+*       ven efter avslut. Utgngar som inte kan ppnas p nytt eller inte
+*       stder epoll (vanliga filer, uttag) skrivs blockerande via output_fd
+*       och ger drmed aldrig mottryck.
+*
+*       - output_fd: Filbeskrivare fr sammanslagen utdata, eller -1.
+*       - baud     : Baud rate fr seriella portar.
+*       - period_ns: Frvntad tid mellan utskrifter frn en enhet.
+********************************************************************************/
+bool device_mux::init(const int output_fd, const long baud, const int64_t period_ns)
+{
+   if (tty_baud_to_speed(baud) == B0)
+   {
+      fprintf(stderr, "device_mux: Baud rate %ld stds inte!\n", baud);
+      return false;
+   }
+
+   epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+
+   if (epoll_fd_ < 0)
+   {
+      fprintf(stderr, "epoll_create1: %s\n", strerror(errno));
+      return false;
+   }
+
+   baud_ = baud;
+   period_ns_ = period_ns;
+   output_fd_ = output_fd;
+
+   if (output_fd_ >= 0)
+   {
+      char path[32];
+      snprintf(path, sizeof(path), "/proc/self/fd/%d", output_fd);
+      const int fd = open(path, O_WRONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+      struct epoll_event ev;
+      ev.events = 0;
+      ev.data.u32 = OUTPUT_ID;
+
+      if (fd >= 0 && epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == 0)
+      {
+         output_fd_ = fd;
+         output_owned_ = true;
+         output_pollable_ = true;
+      }
+      else if (fd >= 0)
+      {
+         close(fd);
+      }
+   }
+
+   return true;
+}
+
+/********************************************************************************
+* add_device: Lgger till en enhet och frsker ansluta direkt.
+*
+*             - path  : Skvg till seriell port eller pseudoterminal.
+*             - sensor: Sensor-id fr textrader frn enheten.
+********************************************************************************/
+uint32_t device_mux::add_device(const char* path, const uint16_t sensor)
+{
+   const uint32_t id = (uint32_t)devices_.size();
+   devices_.emplace_back();
+   devices_.back().path = path;
+   devices_.back().sensor = sensor;
+   (void)connect_device(id, now_ns());
+   return id;
+}
+
+/********************************************************************************
+* connected_devices: Returnerar antalet anslutna enheter.
+********************************************************************************/
+size_t device_mux::connected_devices(void) const
+{
+   size_t count = 0;
+
+   for (const device& dev : devices_)
+   {
+      if (dev.fd >= 0) ++count;
+   }
+
+   return count;
+}
+
+/********************************************************************************
+* connect_device: ppnar angiven enhet icke-blockerande och registrerar den i
+*                 epoll. Misslyckas det schemalggs ett nytt frsk med
+*                 frdubblad vntetid, dock hgst DEVICE_MUX_RETRY_MAX_MS.
+*
+*                 - id : Enhetens index.
+*                 - now: Aktuell tid i nanosekunder.
+********************************************************************************/
+bool device_mux::connect_device(const uint32_t id, const int64_t now)
+{
+   device& dev = devices_[id];
+   const int fd = open(dev.path.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+   struct epoll_event ev;
+   ev.events = paused_ ? 0U : (uint32_t)EPOLLIN;
+   ev.data.u32 = id;
+
+   if (fd < 0 ||
+       (isatty(fd) && !tty_configure_raw(fd, tty_baud_to_speed(baud_))) ||
+       epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0)
+   {
+      if (fd >= 0) close(fd);
+      dev.retry_at_ns = now + (int64_t)dev.retry_ms * 1000000LL;
+      dev.retry_ms = dev.retry_ms * 2 < DEVICE_MUX_RETRY_MAX_MS ? dev.retry_ms * 2 : DEVICE_MUX_RETRY_MAX_MS;
+      return false;
+   }
+
+   if (dev.ever_connected) ++stats_.reconnects;
+   dev.fd = fd;
+   dev.ever_connected = true;
+   dev.retry_ms = DEVICE_MUX_RETRY_MIN_MS;
+   dev.parser.reset();
+   return true;
+}
+
+/********************************************************************************
+* disconnect_device: Stnger angiven enhet och schemalgger teranslutning.
+*                    Sekvensuppfljningen behlls, s att poster som gr
+*                    frlorade under avbrottet rknas som glapp.
+*
+*                    - id : Enhetens index.
+*                    - now: Aktuell tid i nanosekunder.
+********************************************************************************/
+void device_mux::disconnect_device(const uint32_t id, const int64_t now)
+{
+   device& dev = devices_[id];
+   epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, dev.fd, nullptr);
+   close(dev.fd);
+   dev.fd = -1;
+   dev.retry_at_ns = now + (int64_t)dev.retry_ms * 1000000LL;
+   return;
+}
+
+/********************************************************************************
+* estimate_gap: Uppskattar antalet saknade textrader fre en lsning som gav
+*               textrader, och uppdaterar enhetens mottagningstid.
+*
+*               Antalet hela utskriftsperioder sedan fregende lsning med
+*               textrader jmfrs med antalet rader i lsningen, om tiden
+*               verstiger 1.5 perioder. Rader som frdrjts och kommer i
+*               samma lsning ger drmed inga falska glapp. Frsta lsningen
+*               efter en paus uppskattas inte alls, eftersom raderna d legat
+*               kvar i krnans buffertar. Extra utskrifter vid knapptryckning
+*               (se interrupts.c) frkortar bara intervallen.
+*
+*               - dev: Enhetens tillstnd.
+*               - now: Mottagningstid i nanosekunder.
+********************************************************************************/
+uint32_t device_mux::estimate_gap(device& dev, const int64_t now)
+{
+   size_t lines = 0;
+   uint32_t estimated = 0;
+
+   for (const record& r : records_)
+   {
+      if (!r.has_seq) ++lines;
+   }
+
+   if (lines == 0) return 0;
+
+   if (period_ns_ > 0 && dev.last_text_ns > 0 && !dev.resumed)
+   {
+      const int64_t elapsed = now - dev.last_text_ns;
+
+      if (elapsed > period_ns_ + period_ns_ / 2)
+      {
+         const uint64_t periods = (uint64_t)((elapsed + period_ns_ / 2) / period_ns_);
+         if (periods > lines) estimated = (uint32_t)(periods - lines);
+      }
+   }
+
+   dev.last_text_ns = now;
+   dev.resumed = false;
+   return estimated;
+}
+
+/********************************************************************************
+* emit: Berknar glapp fr en mottagen post, lgger till den i utgngens k
+*       och anropar eventuell krok. Fr binra ramar r glappet skillnaden
+*       mellan mottaget och frvntat sekvensnummer (modulo 2^16). Skillnader
+*       ver 2^15 tolkas som omstart eller dubblett och ger inget glapp.
+*
+*       - dev      : Enhetens tillstnd.
+*       - id       : Enhetens index.
+*       - r        : Den tolkade posten.
+*       - now      : Mottagningstid i nanosekunder.
+*       - estimated: Uppskattat antal saknade textrader fre posten.
+********************************************************************************/
+void device_mux::emit(device& dev, const uint32_t id, const record& r,
+                      const int64_t now, const uint32_t estimated)
+{
+   uint32_t gap = 0;
+
+   if (r.has_seq)
+   {
+      if (dev.has_frame_seq)
+      {
+         const uint16_t diff = (uint16_t)(r.seq - (uint16_t)(dev.last_frame_seq + 1));
+         if (diff < 0x8000) gap = diff;
+      }
+      else if (dev.index == 0)
+      {
+         dev.seq = r.seq;
+      }
+
+      dev.has_frame_seq = true;
+      dev.last_frame_seq = r.seq;
+   }
+
+   dev.seq += gap;
+
+   merged_record m;
+   m.timestamp_ns = now;
+   m.device = id;
+   m.sensor = r.has_seq ? r.sensor : dev.sensor;
+   m.value_centi = r.value_centi;
+   m.index = dev.index++;
+   m.seq = dev.seq++;
+   m.gap = gap;
+   m.estimated = estimated;
+
+   ++stats_.records;
+   stats_.missing += gap;
+   stats_.estimated += estimated;
+
+   if (output_fd_ >= 0)
+   {
+      char line[128];
+      const int len = snprintf(line, sizeof(line), "%lld %u %u %d %llu %u %u\n",
+                               (long long)m.timestamp_ns, m.device, m.sensor, m.value_centi,
+                               (unsigned long long)m.seq, m.gap, m.estimated);
+      out_.append(line, (size_t)len);
+   }
+
+   if (hook_) hook_(m, hook_context_);
+   return;
+}
+
+/********************************************************************************
+* read_device: Gr en lsning om hgst DEVICE_MUX_READ_SIZE byte frn angiven
+*              enhet och tolkar den direkt i lsbufferten. En lsning per
+*              enhet och varv gr att ingen enskild enhet kan svlta ut de
+*              andra. Returnerar false ifall enheten ska kopplas ned.
+*
+*              - id: Enhetens index.
+********************************************************************************/
+bool device_mux::read_device(const uint32_t id)
+{
+   static uint8_t buffer[DEVICE_MUX_READ_SIZE];
+   device& dev = devices_[id];
+   const ssize_t n = read(dev.fd, buffer, sizeof(buffer));
+
+   if (n < 0) return errno == EAGAIN || errno == EINTR;
+   if (n == 0) return false;
+
+   const int64_t now = now_ns();
+   const uint64_t bad_before = dev.parser.bad_records;
+   const uint64_t dropped_before = dev.parser.dropped_bytes;
+
+   records_.clear();
+   dev.parser.feed(buffer, (size_t)n, records_);
+   stats_.bytes += (uint64_t)n;
+   stats_.bad_records += dev.parser.bad_records - bad_before;
+   stats_.dropped_bytes += dev.parser.dropped_bytes - dropped_before;
+
+   uint32_t estimated = estimate_gap(dev, now);
+
+   for (const record& r : records_)
+   {
+      emit(dev, id, r, now, r.has_seq ? 0 : estimated);
+      if (!r.has_seq) estimated = 0;
+   }
+
+   return true;
+}
+
+/********************************************************************************
+* set_paused: Pausar eller terupptar lsning frn alla anslutna enheter.
+*             Under paus bevakas i stllet utgngen fr skrivbarhet. Vid
+*             terupptagning markeras enheterna, s att rader som vntat i
+*             krnans buffertar inte ger uppskattade glapp.
+*
+*             - paused: Indikerar ifall lsning ska pausas.
+********************************************************************************/
+void device_mux::set_paused(const bool paused)
+{
+   struct epoll_event ev;
+   paused_ = paused;
+   if (paused) ++stats_.pauses;
+
+   for (uint32_t id = 0; id < devices_.size(); ++id)
+   {
+      if (devices_[id].fd < 0) continue;
+      if (!paused) devices_[id].resumed = true;
+      ev.events = paused ? 0U : (uint32_t)EPOLLIN;
+      ev.data.u32 = id;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, devices_[id].fd, &ev);
+   }
+
+   ev.events = paused ? (uint32_t)EPOLLOUT : 0U;
+   ev.data.u32 = OUTPUT_ID;
+   epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, output_fd_, &ev);
+   return;
+}
+
+/********************************************************************************
+* write_output: Skriver s mycket kad utdata som utgngen tar emot utan att
+*               blockera. Returnerar false vid skrivfel.
+********************************************************************************/
+bool device_mux::write_output(void)
+{
+   while (out_offset_ < out_.size())
+   {
+      const ssize_t n = write(output_fd_, out_.data() + out_offset_, out_.size() - out_offset_);
+
+      if (n > 0)
+      {
+         out_offset_ += (size_t)n;
+      }
+      else if (n < 0 && errno == EINTR)
+      {
+         continue;
+      }
+      else if (n < 0 && errno == EAGAIN)
+      {
+         break;
+      }
+      else
+      {
+         fprintf(stderr, "device_mux: %s\n", strerror(errno));
+         return false;
+      }
+   }
+
+   if (out_offset_ == out_.size())
+   {
+      out_.clear();
+      out_offset_ = 0;
+   }
+   else if (out_offset_ >= DEVICE_MUX_LOW_WATER)
+   {
+      out_.erase(0, out_offset_);
+      out_offset_ = 0;
+   }
+
+   return true;
+}
+
+/********************************************************************************
+* poll_once: Vntar p och hanterar hndelser i hgst timeout_ms ms.
+*
+*            1. Frnkopplade enheter vars vntetid lpt ut teransluts, och
+*               tiden till nsta frsk begrnsar vntan i epoll_wait.
+*
+*            2. Varje lsbar enhet lses en gng. En enhet som rapporterar
+*               avbrott eller fel, eller vars lsning ger EOF eller EIO,
+*               kopplas ned.
+*
+*            3. Kad utdata skrivs ut, varefter lsning pausas eller
+*               terupptas beroende p kns lngd.
+********************************************************************************/
+bool device_mux::poll_once(const int timeout_ms)
+{
+   int64_t now = now_ns();
+   int64_t timeout_ns = (int64_t)timeout_ms * 1000000LL;
+
+   for (uint32_t id = 0; id < devices_.size(); ++id)
+   {
+      device& dev = devices_[id];
+      if (dev.fd >= 0) continue;
+      if (dev.retry_at_ns <= now && connect_device(id, now)) continue;
+      if (dev.retry_at_ns - now < timeout_ns) timeout_ns = dev.retry_at_ns - now;
+   }
+
+   struct epoll_event events[DEVICE_MUX_MAX_EVENTS];
+   const int timeout = timeout_ns > 0 ? (int)((timeout_ns + 999999) / 1000000) : 0;
+   const int n = epoll_wait(epoll_fd_, events, DEVICE_MUX_MAX_EVENTS, timeout);
+
+   if (n < 0)
+   {
+      if (errno == EINTR) return true;
+      fprintf(stderr, "epoll_wait: %s\n", strerror(errno));
+      return false;
+   }
+
+   now = now_ns();
+
+   for (int i = 0; i < n; ++i)
+   {
+      const uint32_t id = events[i].data.u32;
+      if (id == OUTPUT_ID) continue;
+      if (devices_[id].fd < 0) continue;
+
+      const bool readable = (events[i].events & EPOLLIN) && !paused_;
+      const bool failed = (events[i].events & (EPOLLHUP | EPOLLERR)) != 0;
+
+      if ((readable || failed) && !read_device(id))
+      {
+         disconnect_device(id, now);
+      }
+   }
+
+   if (output_fd_ < 0) return true;
+   if (!write_output()) return false;
+
+   const size_t pending = out_.size() - out_offset_;
+
+   if (!paused_ && pending > DEVICE_MUX_HIGH_WATER)
+   {
+      set_paused(true);
+   }
+   else if (paused_ && pending < DEVICE_MUX_LOW_WATER)
+   {
+      set_paused(false);
+   }
+
+   return true;
+}
+
+/********************************************************************************
+* flush: Skriver ut all kad utdata och vntar vid behov p att utgngen
+*        blir skrivbar.
+********************************************************************************/
+bool device_mux::flush(void)
+{
+   while (output_fd_ >= 0 && out_offset_ < out_.size())
+   {
+      if (!write_output()) return false;
+
+      if (out_offset_ < out_.size())
+      {
+         struct pollfd pfd = { output_fd_, POLLOUT, 0 };
+         (void)poll(&pfd, 1, -1);
+      }
+   }
+
+   return true;
+}
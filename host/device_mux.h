@@ -0,0 +1,178 @@
+/********************************************************************************
+* device_mux.h: Multiplexering av mnga seriella enheter (seriella portar
+*               eller pseudoterminaler) i en enda trd med epoll.
+*
+*               Varje enhet har ett eget tolkningstillstnd (stream_parser),
+*               en egen teranslutningstimer samt egen sekvensuppfljning.
+*               Mottagna poster skrivs ut sammanslagna till en utgng, en
+*               rad per post:
+*
+*               <tid_ns> <enhet> <sensor> <vrde_centi> <seq> <glapp> <uppskattat>
+*
+*               dr glapp anger antalet poster som saknas frn enheten
+*               direkt fre denna post enligt binra ramars sekvensnummer.
+*               Textformatet saknar sekvensnummer, s dr anger uppskattat
+*               i stllet ett antal saknade poster uppskattat frn tiden
+*               sedan fregende lsning och enhetens utskriftsperiod.
+*               Frdrjd mottagning kan ge falska uppskattningar, som drfr
+*               hlls tskilda frn glappen.
+*
+*               Utgngen ppnas p nytt via /proc/self/fd, s att den
+*               icke-blockerande skrivningen inte pverkar anroparens
+*               filbeskrivare (exempelvis en terminal som delas med stderr).
+*
+*               Mottryck: Nr utgngen inte hinner ta emot data och mer n
+*               DEVICE_MUX_HIGH_WATER byte ligger i k slutar multiplexern
+*               lsa frn enheterna, s att data i stllet blir kvar i
+*               krnans buffertar, tills kn sjunkit under
+*               DEVICE_MUX_LOW_WATER byte.
+********************************************************************************/
+#ifndef DEVICE_MUX_H_
+#define DEVICE_MUX_H_
+
+/* Inkluderingsdirektiv: */
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "stream_parser.h"
+
+/* Makrodefinitioner: */
+#define DEVICE_MUX_READ_SIZE 4096          /* Hgst antal byte per lsning och enhet. */
+#define DEVICE_MUX_MAX_EVENTS 256          /* Hgst antal hndelser per epoll_wait. */
+#define DEVICE_MUX_HIGH_WATER (4UL << 20)  /* Pausa lsning ver denna klngd. */
+#define DEVICE_MUX_LOW_WATER (1UL << 20)   /* teruppta lsning under denna klngd. */
+#define DEVICE_MUX_RETRY_MIN_MS 100        /* Frsta vntetid fre teranslutning. */
+#define DEVICE_MUX_RETRY_MAX_MS 5000       /* Lngsta vntetid fre teranslutning. */
+
+/********************************************************************************
+* merged_record: En mottagen post efter sammanslagning.
+********************************************************************************/
+struct merged_record
+{
+   int64_t timestamp_ns; /* Mottagningstid (CLOCK_REALTIME) i nanosekunder. */
+   uint32_t device;      /* Enhetens index i multiplexern. */
+   uint16_t sensor;      /* Sensor-id. */
+   int32_t value_centi;  /* Temperaturen i hundradels grader Celcius. */
+   uint64_t index;       /* Antal tidigare mottagna poster frn enheten. */
+   uint64_t seq;         /* Postens plats i enhetens strm inklusive glapp. */
+   uint32_t gap;         /* Antal saknade poster direkt fre denna. */
+   uint32_t estimated;   /* Uppskattat antal saknade poster (textformatet). */
+};
+
+/********************************************************************************
+* device_mux_stats: Rknare fr hela multiplexern.
+********************************************************************************/
+struct device_mux_stats
+{
+   uint64_t records = 0;       /* Antal mottagna poster. */
+   uint64_t bytes = 0;         /* Antal lsta byte. */
+   uint64_t missing = 0;       /* Summan av alla upptckta glapp. */
+   uint64_t estimated = 0;     /* Summan av alla uppskattade glapp. */
+   uint64_t bad_records = 0;   /* Antal poster som inte gick att tolka. */
+   uint64_t dropped_bytes = 0; /* Antal byte som kastades vid omsynkronisering. */
+   uint64_t reconnects = 0;    /* Antal lyckade teranslutningar. */
+   uint64_t pauses = 0;        /* Antal gnger som lsning pausats av mottryck. */
+};
+
+/********************************************************************************
+* device_mux: Multiplexer fr seriella enheter.
+********************************************************************************/
+class device_mux
+{
+public:
+   typedef void (*record_hook)(const merged_record& r, void* context);
+
+   device_mux(void) = default;
+   device_mux(const device_mux&) = delete;
+   device_mux& operator=(const device_mux&) = delete;
+   ~device_mux(void);
+
+   /********************************************************************************
+   * init: Skapar epoll-instansen. Returnerar false vid fel.
+   *
+   *       - output_fd: Filbeskrivare fr sammanslagen utdata, eller -1 fr
+   *                    ingen utdata.
+   *       - baud     : Baud rate fr seriella portar.
+   *       - period_ns: Frvntad tid mellan utskrifter frn en enhet, som
+   *                    anvnds fr att uppskatta glapp i textformatet
+   *                    (0 = ingen uppskattning).
+   ********************************************************************************/
+   bool init(const int output_fd, const long baud, const int64_t period_ns);
+
+   /********************************************************************************
+   * add_device: Lgger till en enhet och returnerar dess index. Enheten
+   *             ppnas direkt, och gr det inte grs nya frsk senare.
+   *
+   *             - path  : Skvg till seriell port eller pseudoterminal.
+   *             - sensor: Sensor-id fr textrader frn enheten.
+   ********************************************************************************/
+   uint32_t add_device(const char* path, const uint16_t sensor);
+
+   /********************************************************************************
+   * poll_once: Vntar p och hanterar hndelser i hgst timeout_ms ms.
+   *            Returnerar false vid ett fel som krver avslut.
+   ********************************************************************************/
+   bool poll_once(const int timeout_ms);
+
+   /********************************************************************************
+   * flush: Skriver ut kad utdata, blockerande. Anropas fre avslut.
+   ********************************************************************************/
+   bool flush(void);
+
+   /********************************************************************************
+   * set_record_hook: Anger en funktion som anropas fr varje sammanslagen
+   *                  post, exempelvis fr latensmtning.
+   ********************************************************************************/
+   void set_record_hook(const record_hook hook, void* context) { hook_ = hook; hook_context_ = context; }
+
+   const device_mux_stats& stats(void) const { return stats_; }
+   size_t connected_devices(void) const;
+
+private:
+   /********************************************************************************
+   * device: Tillstnd fr en enskild enhet.
+   ********************************************************************************/
+   struct device
+   {
+      std::string path;                            /* Skvg till enheten. */
+      uint16_t sensor = 0;                         /* Sensor-id fr textrader. */
+      int fd = -1;                                 /* Filbeskrivare, -1 d enheten inte r ansluten. */
+      bool ever_connected = false;                 /* Indikerar ifall enheten har varit ansluten. */
+      stream_parser parser;                        /* Tolkningstillstnd. */
+      int64_t retry_at_ns = 0;                     /* Tidpunkt fr nsta anslutningsfrsk. */
+      uint32_t retry_ms = DEVICE_MUX_RETRY_MIN_MS; /* Aktuell vntetid fre teranslutning. */
+      bool has_frame_seq = false;                  /* Indikerar ifall en ram har tagits emot. */
+      uint16_t last_frame_seq = 0;                 /* Sekvensnummer i senaste ramen. */
+      int64_t last_text_ns = 0;                    /* Mottagningstid fr senaste textrad. */
+      bool resumed = false;                        /* Indikerar ifall lsning nyss terupptagits. */
+      uint64_t index = 0;                          /* Antal mottagna poster. */
+      uint64_t seq = 0;                            /* Nsta postnummer inklusive glapp. */
+   };
+
+   bool connect_device(const uint32_t id, const int64_t now);
+   void disconnect_device(const uint32_t id, const int64_t now);
+   bool read_device(const uint32_t id);
+   uint32_t estimate_gap(device& dev, const int64_t now);
+   void emit(device& dev, const uint32_t id, const record& r, const int64_t now, const uint32_t estimated);
+   void set_paused(const bool paused);
+   bool write_output(void);
+
+   int epoll_fd_ = -1;            /* Epoll-instansens filbeskrivare. */
+   int output_fd_ = -1;           /* Utgngens filbeskrivare. */
+   bool output_owned_ = false;    /* Indikerar ifall utgngen ppnats av multiplexern. */
+   bool output_pollable_ = false; /* Indikerar ifall utgngen stder epoll. */
+   bool paused_ = false;          /* Indikerar ifall lsning r pausad av mottryck. */
+   long baud_ = 9600;             /* Baud rate fr seriella portar. */
+   int64_t period_ns_ = 0;        /* Frvntad tid mellan utskrifter. */
+   std::vector<device> devices_;  /* Alla enheter. */
+   std::string out_;              /* Kad utdata. */
+   size_t out_offset_ = 0;        /* Antal redan skrivna byte i out_. */
+   std::vector<record> records_;  /* teranvnds mellan lsningar. */
+   device_mux_stats stats_;
+   record_hook hook_ = nullptr;
+   void* hook_context_ = nullptr;
+};
+
+#endif /* DEVICE_MUX_H_ */
@@ -0,0 +1,353 @@
+/********************************************************************************
+* load_test.cpp: Lasttest av device_mux med mnga simulerade kort. Varje kort
+*                simuleras med en pseudoterminal som en barnprocess skriver
+*                mikrodatorns utskriftsformat till, medan multiplexern i
+*                frldraprocessen lser frn motsvarande slavsida.
+*
+*                Barnprocessen lagrar sndningstiden fr varje post i delat
+*                minne, s att latensen frn skrivning till sammanslagen post
+*                kan mtas. CPU-tiden mts endast fr frldraprocessen.
+*
+*                Anvndning:
+*
+*                load_test [-d enheter] [-r takt] [-t sekunder] [-m] [-x k] [-o fil]
+*
+*                - enheter : Antal simulerade kort, frvalt 200.
+*                - takt    : Utskrifter per sekund och kort, frvalt 10.
+*                - sekunder: Testets lngd, frvalt 10.
+*                - m       : Skicka binra ramar med sekvensnummer i stllet
+*                            fr textrader.
+*                - k       : Utelmna var k:e post (k >= 2) fr att kontrollera
+*                            att glappen upptcks.
+*                - fil     : Fil fr sammanslagen utdata, frvalt /dev/null.
+*
+*                Testet misslyckas om inte alla skickade poster tas emot. Fr
+*                binra ramar ska exakt de utelmnade ramar som gr att
+*                upptcka rknas som glapp. En utelmnad sista post fljs
+*                inte av ngon post och kan drfr inte upptckas.
+*
+*                Fr textrader uppskattas glappen frn mottagningstiderna.
+*                Utan utelmnade rader ska uppskattningen vara exakt noll,
+*                och annars fr den avvika hgst ESTIMATE_TOLERANCE_PCT
+*                procent frn antalet upptckbara utelmnade rader.
+*                Uppskattningen frutstter att en rad inte frsenas mer n
+*                en halv period, s vid hgre takt n vad processerna hinner
+*                med misslyckas testet.
+********************************************************************************/
+#include "device_mux.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+/* Makrodefinitioner: */
+#define DRAIN_TIMEOUT_S 5        /* Lngsta vntan p kvarvarande poster efter testet. */
+#define ESTIMATE_TOLERANCE_PCT 5 /* Tillten avvikelse i procent fr uppskattade glapp. */
+
+/********************************************************************************
+* load_test: Delat tillstnd mellan testets delar.
+********************************************************************************/
+struct load_test
+{
+   size_t devices = 200;              /* Antal simulerade kort. */
+   double rate = 10;                  /* Utskrifter per sekund och kort. */
+   double seconds = 10;               /* Testets lngd i sekunder. */
+   bool frames = false;               /* Indikerar ifall binra ramar skickas. */
+   size_t skip_every = 0;             /* Utelmna var k:e post (0 = ingen). */
+   size_t messages = 0;               /* Antal poster per kort. */
+   int64_t* send_ns = nullptr;        /* Sndningstid per kort och post (delat minne). */
+   std::vector<int64_t> latencies_ns; /* Uppmtta latenser. */
+};
+
+/********************************************************************************
+* now_ns: Returnerar aktuell tid i nanosekunder sedan epoken.
+********************************************************************************/
+static int64_t now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_REALTIME, &ts);
+   return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/********************************************************************************
+* cpu_seconds: Returnerar processens frbrukade CPU-tid (user + sys).
+********************************************************************************/
+static double cpu_seconds(void)
+{
+   struct rusage ru;
+   getrusage(RUSAGE_SELF, &ru);
+   return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+}
+
+/********************************************************************************
+* open_pty: Skapar en pseudoterminal och returnerar masterns filbeskrivare.
+*           Slavsidans skvg lagras i path.
+********************************************************************************/
+static int open_pty(std::string& path)
+{
+   const int fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+
+   if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0)
+   {
+      if (fd >= 0) close(fd);
+      return -1;
+   }
+
+   path = ptsname(fd);
+   return fd;
+}
+
+/********************************************************************************
+* run_devices: Barnprocessens huvudloop. Posterna sprids jmnt i tiden ver
+*              alla kort, s att den totala takten blir devices * rate.
+*              Ligger processen efter schemat skrivs poster utan vntan.
+*              Masterna hlls ppna tills frldraprocessen stnger go_fd,
+*              eftersom olst data p slavsidan annars kastas vid avslut.
+*
+*              - t     : Testets tillstnd.
+*              - master: Masterns filbeskrivare per kort.
+*              - go_fd : Lses innan frsta posten skickas och tills EOF
+*                        innan processen avslutas.
+********************************************************************************/
+static void run_devices(const load_test& t, const std::vector<int>& master, const int go_fd)
+{
+   char go;
+   if (read(go_fd, &go, 1) != 1) return;
+
+   const size_t total = t.devices * t.messages;
+   const double interval_ns = 1e9 / (t.rate * t.devices);
+   const int64_t start = now_ns();
+   std::vector<uint16_t> code(t.devices, 153);
+   uint32_t rng = 12345;
+
+   for (size_t e = 0; e < total; ++e)
+   {
+      const int64_t target = start + (int64_t)(e * interval_ns);
+
+      if (now_ns() < target)
+      {
+         struct timespec ts = { (time_t)(target / 1000000000LL), (long)(target % 1000000000LL) };
+         clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, nullptr);
+      }
+
+      const size_t d = e % t.devices;
+      const size_t k = e / t.devices;
+      rng = rng * 1103515245 + 12345;
+      const int step = (int)((rng >> 16) % 3) - 1;
+      if ((code[d] > 0 || step > 0) && (code[d] < 1023 || step < 0)) code[d] = (uint16_t)(code[d] + step);
+
+      if (t.skip_every && k % t.skip_every == t.skip_every - 1) continue;
+
+      char buf[RECORD_MAX_LEN];
+      size_t len = FRAME_SIZE;
+
+      if (t.frames)
+      {
+         frame_encode((uint8_t*)buf, (uint8_t)d, SAMPLE_RAW_ADC, (uint16_t)k, (int16_t)code[d]);
+      }
+      else
+      {
+         int32_t value_centi;
+         len = format_line(buf, tmp36_code_to_celcius(code[d]), &value_centi);
+      }
+
+      __atomic_store_n(&t.send_ns[d * t.messages + k], now_ns(), __ATOMIC_RELEASE);
+
+      for (size_t done = 0; done < len;)
+      {
+         const ssize_t n = write(master[d], buf + done, len - done);
+         if (n < 0 && errno != EINTR) return;
+         if (n > 0) done += (size_t)n;
+      }
+   }
+
+   while (read(go_fd, &go, 1) > 0);
+   return;
+}
+
+/********************************************************************************
+* on_record: Krok som anropas fr varje sammanslagen post och mter latensen.
+*            Fr binra ramar anvnds postens sekvensnummer, fr textrader
+*            ordningsnumret, fr att hitta motsvarande sndningstid. Var
+*            skip_every:e post skickas aldrig, s ordningsnumret rknas om
+*            till postnummer med hnsyn till de utelmnade posterna.
+********************************************************************************/
+static void on_record(const merged_record& r, void* context)
+{
+   load_test& t = *(load_test*)context;
+   const uint64_t k = t.frames ? r.seq : t.skip_every ? r.index + r.index / (t.skip_every - 1) : r.index;
+   if (k >= t.messages) return;
+
+   const int64_t sent = __atomic_load_n(&t.send_ns[r.device * t.messages + k], __ATOMIC_ACQUIRE);
+   if (sent > 0) t.latencies_ns.push_back(r.timestamp_ns - sent);
+   return;
+}
+
+/********************************************************************************
+* percentile_us: Returnerar angiven percentil av sorterade latenser i s.
+********************************************************************************/
+static double percentile_us(const std::vector<int64_t>& sorted, const double p)
+{
+   if (sorted.empty()) return 0;
+   const size_t i = (size_t)(p / 100 * (sorted.size() - 1) + 0.5);
+   return sorted[i] / 1e3;
+}
+
+/********************************************************************************
+* main: Skapar pseudoterminalerna, startar barnprocessen och kr
+*       multiplexern tills alla skickade poster tagits emot eller testets
+*       lngd plus DRAIN_TIMEOUT_S sekunder passerat, varefter resultatet
+*       skrivs ut.
+********************************************************************************/
+int main(int argc, char** argv)
+{
+   load_test t;
+   const char* output = "/dev/null";
+   int opt;
+
+   while ((opt = getopt(argc, argv, "d:r:t:mx:o:")) != -1)
+   {
+      switch (opt)
+      {
+      case 'd': t.devices = strtoull(optarg, nullptr, 10); break;
+      case 'r': t.rate = strtod(optarg, nullptr); break;
+      case 't': t.seconds = strtod(optarg, nullptr); break;
+      case 'm': t.frames = true; break;
+      case 'x': t.skip_every = strtoull(optarg, nullptr, 10); break;
+      case 'o': output = optarg; break;
+      default: optind = argc + 1; break;
+      }
+   }
+
+   t.messages = (size_t)(t.rate * t.seconds);
+
+   if (optind != argc || t.devices == 0 || t.devices > 4096 || t.messages == 0 ||
+       t.skip_every == 1 || (t.frames && t.messages > 0xFFFF))
+   {
+      fprintf(stderr, "Anvndning: %s [-d enheter] [-r takt] [-t sekunder] [-m] [-x k] [-o fil]\n", argv[0]);
+      return 2;
+   }
+
+   struct rlimit rl;
+   getrlimit(RLIMIT_NOFILE, &rl);
+   rl.rlim_cur = rl.rlim_max;
+   setrlimit(RLIMIT_NOFILE, &rl);
+
+   std::vector<int> master(t.devices);
+   std::vector<std::string> slave(t.devices);
+
+   for (size_t d = 0; d < t.devices; ++d)
+   {
+      master[d] = open_pty(slave[d]);
+
+      if (master[d] < 0)
+      {
+         fprintf(stderr, "Kunde inte skapa pseudoterminal %zu: %s\n", d, strerror(errno));
+         return 1;
+      }
+   }
+
+   const size_t shared_size = t.devices * t.messages * sizeof(int64_t);
+   t.send_ns = (int64_t*)mmap(nullptr, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+   int go[2];
+
+   if (t.send_ns == MAP_FAILED || pipe(go) != 0)
+   {
+      perror("mmap/pipe");
+      return 1;
+   }
+
+   const pid_t child = fork();
+
+   if (child == 0)
+   {
+      close(go[1]);
+      run_devices(t, master, go[0]);
+      _exit(0);
+   }
+
+   close(go[0]);
+   for (const int fd : master) close(fd);
+
+   const int output_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   device_mux mux;
+
+   if (child < 0 || output_fd < 0 || !mux.init(output_fd, 9600, (int64_t)(1e9 / t.rate)))
+   {
+      perror("load_test");
+      if (child > 0) kill(child, SIGKILL);
+      return 1;
+   }
+
+   for (size_t d = 0; d < t.devices; ++d)
+   {
+      mux.add_device(slave[d].c_str(), (uint16_t)d);
+   }
+
+   t.latencies_ns.reserve(t.devices * t.messages);
+   mux.set_record_hook(on_record, &t);
+
+   const size_t skipped = t.skip_every ? t.devices * (t.messages / t.skip_every) : 0;
+   const size_t detectable = t.skip_every ? t.devices * ((t.messages - 1) / t.skip_every) : 0;
+   const size_t sent = t.devices * t.messages - skipped;
+   const double cpu_start = cpu_seconds();
+   const int64_t wall_start = now_ns();
+   const int64_t deadline = wall_start + (int64_t)((t.seconds + DRAIN_TIMEOUT_S) * 1e9);
+   bool ok = write(go[1], "g", 1) == 1;
+
+   while (ok && mux.stats().records < sent && now_ns() < deadline)
+   {
+      ok = mux.poll_once(100);
+   }
+
+   close(go[1]);
+   waitpid(child, nullptr, 0);
+   ok = mux.flush() && ok;
+   const double cpu = cpu_seconds() - cpu_start;
+   const double wall = (now_ns() - wall_start) / 1e9;
+   const device_mux_stats& stats = mux.stats();
+
+   std::sort(t.latencies_ns.begin(), t.latencies_ns.end());
+
+   printf("Enheter: %zu, takt: %.1f/s per enhet (%.0f/s totalt), %s\n",
+          t.devices, t.rate, t.rate * t.devices, t.frames ? "binra ramar" : "textrader");
+   printf("Skickade: %zu, mottagna: %llu, saknade: %llu (utelmnade: %zu, upptckbara: %zu), "
+          "uppskattat saknade: %llu, felaktiga: %llu\n",
+          sent, (unsigned long long)stats.records, (unsigned long long)stats.missing,
+          skipped, detectable, (unsigned long long)stats.estimated,
+          (unsigned long long)stats.bad_records);
+   printf("CPU: %.2f s per post, %.1f %% av en krna\n",
+          stats.records ? cpu * 1e6 / stats.records : 0.0, cpu / wall * 100);
+   printf("Latens: p50 %.0f s, p99 %.0f s, p99.9 %.0f s, max %.0f s\n",
+          percentile_us(t.latencies_ns, 50), percentile_us(t.latencies_ns, 99),
+          percentile_us(t.latencies_ns, 99.9), percentile_us(t.latencies_ns, 100));
+
+   const size_t found = t.frames ? stats.missing : stats.estimated;
+   const size_t deviation = found > detectable ? found - detectable : detectable - found;
+   const size_t tolerance = t.frames ? 0 : detectable * ESTIMATE_TOLERANCE_PCT / 100;
+
+   if (stats.records != sent)
+   {
+      fprintf(stderr, "Fel: alla poster togs inte emot!\n");
+      return 1;
+   }
+
+   if (deviation > tolerance || (t.frames ? stats.estimated : stats.missing) != 0)
+   {
+      fprintf(stderr, "Fel: %s glapp r %zu men %zu poster utelmnades upptckbart (tolerans %zu)!\n",
+              t.frames ? "antalet upptckta" : "det uppskattade antalet", found, detectable, tolerance);
+      return 1;
+   }
+
+   return ok ? 0 : 1;
+}
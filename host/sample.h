@@ -0,0 +1,65 @@
+/********************************************************************************
+* sample.h: Gemensamma definitioner fr vrdprogrammen som tar emot och lagrar
+*           temperaturmtningar frn mikrodatorn. verfringsfunktionen r
+*           densamma som i tmp36_get_temperature (se tmp36.h och adc.h), men
+*           konstanterna dupliceras hr eftersom adc.h krver avr/io.h.
+********************************************************************************/
+#ifndef SAMPLE_H_
+#define SAMPLE_H_
+
+/* Inkluderingsdirektiv: */
+#include <stdint.h>
+
+/* Makrodefinitioner (samma vrden som i adc.h och timer.h): */
+#define TMP36_ADC_MAX 1023.0        /* Hgsta mjliga resultat vid AD-omvandling. */
+#define TMP36_VCC 5.0               /* 5.0 V matningsspnning. */
+#define TMP36_PRINT_PERIOD_MS 60000 /* Tid mellan utskrifter (TIMER0_ELAPSE_TIME_MS). */
+
+/********************************************************************************
+* sample_kind: Enumeration fr vilken typ av vrde som en mottagen post br.
+********************************************************************************/
+enum sample_kind
+{
+   SAMPLE_CENTI_DEGREES, /* Temperatur i hundradels grader Celcius. */
+   SAMPLE_RAW_ADC        /* Rtt resultat frn AD-omvandlaren (0 - 1023). */
+};
+
+/********************************************************************************
+* record: En tolkad post frn den seriella strmmen, innan tidsstmpel har
+*         satts av mottagaren.
+********************************************************************************/
+struct record
+{
+   uint8_t sensor;      /* Sensor-id (0 fr textformatet, frn ramen annars). */
+   bool has_seq;        /* Indikerar ifall posten br ett sekvensnummer. */
+   uint16_t seq;        /* Sekvensnummer (endast binra ramar). */
+   int32_t value_centi; /* Temperaturen i hundradels grader Celcius. */
+};
+
+/********************************************************************************
+* tmp36_code_to_celcius: Returnerar temperaturen i grader Celcius fr angivet
+*                        resultat frn AD-omvandlaren, exakt som
+*                        tmp36_get_temperature berknar den p mikrodatorn.
+*
+*                        - code: Resultat frn AD-omvandlaren (0 - 1023).
+********************************************************************************/
+static inline double tmp36_code_to_celcius(const uint16_t code)
+{
+   const double voltage = code / TMP36_ADC_MAX * TMP36_VCC;
+   return 100 * voltage - 50;
+}
+
+/********************************************************************************
+* tmp36_code_to_centi: Returnerar temperaturen i hundradels grader Celcius
+*                      fr angivet resultat frn AD-omvandlaren. Avrundning
+*                      sker till nrmaste heltal.
+*
+*                      - code: Resultat frn AD-omvandlaren (0 - 1023).
+********************************************************************************/
+static inline int32_t tmp36_code_to_centi(const uint16_t code)
+{
+   const double centi = tmp36_code_to_celcius(code) * 100;
+   return (int32_t)(centi >= 0 ? centi + 0.5 : centi - 0.5);
+}
+
+#endif /* SAMPLE_H_ */
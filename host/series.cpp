@@ -0,0 +1,810 @@
+/********************************************************************************
+* series.cpp: Innehller definitioner fr frgor och nedsampling ver
+*             inspelade temperaturserier.
+********************************************************************************/
+#include "series.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* Makrodefinitioner: */
+#define SERIES_MAGIC "TMPSER01"        /* Identifierar filformatet. */
+#define SERIES_VERSION 1               /* Filformatets version. */
+#define SERIES_MIN_PER_THREAD (1 << 20) /* Minsta antal vrden per trd. */
+#define SERIES_FLUSH_VECTORS 16384     /* Vektorer mellan tmningar av 32-bitars summor. */
+
+/********************************************************************************
+* series_header: Seriefilens huvud.
+********************************************************************************/
+struct series_header
+{
+   char magic[8];       /* SERIES_MAGIC utan nolltecken. */
+   uint32_t version;    /* SERIES_VERSION. */
+   uint32_t kind;       /* Typ av vrden (sample_kind). */
+   uint64_t count;      /* Antal vrden. */
+   int64_t start_ns;    /* Tidsstmpel fr frsta vrdet. */
+   int64_t interval_ns; /* Tid mellan tv vrden. */
+};
+
+/* Typ fr krnor som berknar min, max och summa. */
+typedef struct series_stats (*stats_kernel)(const int16_t* v, const size_t n);
+
+/********************************************************************************
+* empty_stats: Returnerar statistik fr ett tomt intervall.
+********************************************************************************/
+static struct series_stats empty_stats(void)
+{
+   struct series_stats s = { INT32_MAX, INT32_MIN, 0, 0 };
+   return s;
+}
+
+/********************************************************************************
+* merge_stats: Slr ihop statistik fr tv intervall.
+********************************************************************************/
+static void merge_stats(struct series_stats& into, const struct series_stats& s)
+{
+   if (s.min < into.min) into.min = s.min;
+   if (s.max > into.max) into.max = s.max;
+   into.sum += s.sum;
+   into.count += s.count;
+   return;
+}
+
+/********************************************************************************
+* thread_count: Returnerar antalet trdar att anvnda fr n vrden, med
+*               minst SERIES_MIN_PER_THREAD vrden per trd.
+*
+*               - n        : Antal vrden.
+*               - requested: nskat antal trdar (0 = en per processorkrna).
+********************************************************************************/
+static unsigned thread_count(const size_t n, unsigned requested)
+{
+   if (requested == 0) requested = std::thread::hardware_concurrency();
+   if (requested == 0) requested = 1;
+
+   const size_t useful = n / SERIES_MIN_PER_THREAD;
+   if (useful < requested) requested = useful > 0 ? (unsigned)useful : 1;
+   return requested;
+}
+
+/********************************************************************************
+* parallel_for: Delar upp intervallet [0, n) i parts lika stora delar och
+*               anropar fn(begin, end, part) fr varje del, den frsta i
+*               anropande trd och resten i egna trdar.
+********************************************************************************/
+template <typename F>
+static void parallel_for(const size_t n, const unsigned parts, F fn)
+{
+   std::vector<std::thread> pool;
+
+   for (unsigned part = 1; part < parts; ++part)
+   {
+      pool.emplace_back(fn, n * part / parts, n * (part + 1) / parts, part);
+   }
+
+   fn(0, n / parts, 0U);
+
+   for (std::thread& t : pool)
+   {
+      t.join();
+   }
+
+   return;
+}
+
+/********************************************************************************
+* stats_scalar: Skalr referensimplementation.
+********************************************************************************/
+static struct series_stats stats_scalar(const int16_t* v, const size_t n)
+{
+   struct series_stats s = empty_stats();
+
+   for (size_t i = 0; i < n; ++i)
+   {
+      if (v[i] == SERIES_MISSING) continue;
+      if (v[i] < s.min) s.min = v[i];
+      if (v[i] > s.max) s.max = v[i];
+      s.sum += v[i];
+      ++s.count;
+   }
+
+   return s;
+}
+
+#if defined(__x86_64__)
+
+/********************************************************************************
+* stats_sse2: Behandlar tta vrden t gngen.
+*
+*             1. Min och max berknas lanvis med _mm_min_epi16/_mm_max_epi16.
+*
+*             2. Saknade vrden (SERIES_MISSING = 0x8000) ger en mask. Med
+*                masken XOR:as de till 0x7FFF, som inte pverkar minimum,
+*                och nollas fre summeringen. Som minsta mjliga vrde
+*                pverkar de aldrig maximum.
+*
+*             3. Summan berknas med _mm_madd_epi16 mot ettor, vilket adderar
+*                intilliggande par till 32-bitars summor, och antalet saknade
+*                vrden p samma stt ur masken. Dessa tms till 64-bitars
+*                summor var SERIES_FLUSH_VECTORS:e vektor, innan de kan
+*                svmma ver.
+*
+*             4. Lanerna reduceras och resterande vrden behandlas skalrt.
+********************************************************************************/
+static struct series_stats stats_sse2(const int16_t* v, const size_t n)
+{
+   __m128i vmin = _mm_set1_epi16(INT16_MAX);
+   __m128i vmax = _mm_set1_epi16(INT16_MIN);
+   const __m128i ones = _mm_set1_epi16(1);
+   const __m128i missing = _mm_set1_epi16(SERIES_MISSING);
+   int64_t sum = 0;
+   int64_t absent = 0;
+   size_t i = 0;
+
+   while (n - i >= 8)
+   {
+      const size_t vectors = std::min((n - i) / 8, (size_t)SERIES_FLUSH_VECTORS);
+      const size_t end = i + vectors * 8;
+      __m128i acc = _mm_setzero_si128();
+      __m128i acc_absent = _mm_setzero_si128();
+
+      for (; i < end; i += 8)
+      {
+         const __m128i x = _mm_loadu_si128((const __m128i*)(v + i));
+         const __m128i mask = _mm_cmpeq_epi16(x, missing);
+         vmin = _mm_min_epi16(vmin, _mm_xor_si128(x, mask));
+         vmax = _mm_max_epi16(vmax, x);
+         acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_andnot_si128(mask, x), ones));
+         acc_absent = _mm_sub_epi32(acc_absent, _mm_madd_epi16(mask, ones));
+      }
+
+      int32_t lanes[4];
+      _mm_storeu_si128((__m128i*)lanes, acc);
+      sum += (int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+      _mm_storeu_si128((__m128i*)lanes, acc_absent);
+      absent += (int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+   }
+
+   int16_t mins[8];
+   int16_t maxs[8];
+   _mm_storeu_si128((__m128i*)mins, vmin);
+   _mm_storeu_si128((__m128i*)maxs, vmax);
+
+   struct series_stats s = stats_scalar(v + i, n - i);
+   s.sum += sum;
+   s.count += i - (uint64_t)absent;
+
+   for (int lane = 0; lane < 8 && i > (uint64_t)absent; ++lane)
+   {
+      if (mins[lane] < s.min) s.min = mins[lane];
+      if (maxs[lane] > s.max && maxs[lane] != SERIES_MISSING) s.max = maxs[lane];
+   }
+
+   return s;
+}
+
+/********************************************************************************
+* stats_avx2: Som stats_sse2 men med sexton vrden t gngen.
+********************************************************************************/
+__attribute__((target("avx2")))
+static struct series_stats stats_avx2(const int16_t* v, const size_t n)
+{
+   __m256i vmin = _mm256_set1_epi16(INT16_MAX);
+   __m256i vmax = _mm256_set1_epi16(INT16_MIN);
+   const __m256i ones = _mm256_set1_epi16(1);
+   const __m256i missing = _mm256_set1_epi16(SERIES_MISSING);
+   int64_t sum = 0;
+   int64_t absent = 0;
+   size_t i = 0;
+
+   while (n - i >= 16)
+   {
+      const size_t vectors = std::min((n - i) / 16, (size_t)SERIES_FLUSH_VECTORS);
+      const size_t end = i + vectors * 16;
+      __m256i acc = _mm256_setzero_si256();
+      __m256i acc_absent = _mm256_setzero_si256();
+
+      for (; i < end; i += 16)
+      {
+         const __m256i x = _mm256_loadu_si256((const __m256i*)(v + i));
+         const __m256i mask = _mm256_cmpeq_epi16(x, missing);
+         vmin = _mm256_min_epi16(vmin, _mm256_xor_si256(x, mask));
+         vmax = _mm256_max_epi16(vmax, x);
+         acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_andnot_si256(mask, x), ones));
+         acc_absent = _mm256_sub_epi32(acc_absent, _mm256_madd_epi16(mask, ones));
+      }
+
+      int32_t lanes[8];
+      int32_t absent_lanes[8];
+      _mm256_storeu_si256((__m256i*)lanes, acc);
+      _mm256_storeu_si256((__m256i*)absent_lanes, acc_absent);
+
+      for (int lane = 0; lane < 8; ++lane)
+      {
+         sum += lanes[lane];
+         absent += absent_lanes[lane];
+      }
+   }
+
+   int16_t mins[16];
+   int16_t maxs[16];
+   _mm256_storeu_si256((__m256i*)mins, vmin);
+   _mm256_storeu_si256((__m256i*)maxs, vmax);
+
+   struct series_stats s = stats_scalar(v + i, n - i);
+   s.sum += sum;
+   s.count += i - (uint64_t)absent;
+
+   for (int lane = 0; lane < 16 && i > (uint64_t)absent; ++lane)
+   {
+      if (mins[lane] < s.min) s.min = mins[lane];
+      if (maxs[lane] > s.max && maxs[lane] != SERIES_MISSING) s.max = maxs[lane];
+   }
+
+   return s;
+}
+
+#endif /* __x86_64__ */
+
+/********************************************************************************
+* select_stats_kernel: Returnerar krnan fr angiven instruktionsuppsttning.
+*                      Saknas std anvnds den bsta tillgngliga.
+********************************************************************************/
+static stats_kernel select_stats_kernel(enum series_isa isa)
+{
+   if (isa > series_best_isa()) isa = series_best_isa();
+
+#if defined(__x86_64__)
+   if (isa == SERIES_ISA_AVX2) return stats_avx2;
+   if (isa == SERIES_ISA_SSE2) return stats_sse2;
+#endif
+
+   return stats_scalar;
+}
+
+/********************************************************************************
+* argmax_area_scalar: Returnerar index (relativt v) fr den punkt i [0, n)
+*                     som maximerar |a * v[j] + (b * j + c)|, vilket r
+*                     proportionellt mot triangelarean i series_lttb. Vid
+*                     lika area vljs det lgsta indexet. Saknade vrden
+*                     hoppas ver, och minst ett vrde mste finnas.
+********************************************************************************/
+static size_t argmax_area_scalar(const int16_t* v,
+                                 const size_t n,
+                                 const double a,
+                                 const double b,
+                                 const double c)
+{
+   double best = -1;
+   size_t best_j = 0;
+
+   for (size_t j = 0; j < n; ++j)
+   {
+      if (v[j] == SERIES_MISSING) continue;
+      const double area = fabs(a * v[j] + (b * (double)j + c));
+
+      if (area > best)
+      {
+         best = area;
+         best_j = j;
+      }
+   }
+
+   return best_j;
+}
+
+#if defined(__x86_64__)
+
+/********************************************************************************
+* argmax_area_avx2: Som argmax_area_scalar men med fyra punkter t gngen i
+*                   dubbel precision, s att resultatet blir identiskt.
+*                   Saknade vrden fr arean -1 och vljs drmed aldrig.
+********************************************************************************/
+__attribute__((target("avx2")))
+static size_t argmax_area_avx2(const int16_t* v,
+                               const size_t n,
+                               const double a,
+                               const double b,
+                               const double c)
+{
+   const __m256d va = _mm256_set1_pd(a);
+   const __m256d vb = _mm256_set1_pd(b);
+   const __m256d vc = _mm256_set1_pd(c);
+   const __m256d step = _mm256_set1_pd(4.0);
+   const __m256d sign = _mm256_set1_pd(-0.0);
+   const __m256d missing = _mm256_set1_pd(SERIES_MISSING);
+   const __m256d none = _mm256_set1_pd(-1.0);
+   __m256d vj = _mm256_set_pd(3.0, 2.0, 1.0, 0.0);
+   __m256d best = _mm256_set1_pd(-1.0);
+   __m256d best_j = _mm256_setzero_pd();
+   size_t j = 0;
+
+   for (; j + 4 <= n; j += 4)
+   {
+      const __m128i y16 = _mm_loadl_epi64((const __m128i*)(v + j));
+      const __m256d y = _mm256_cvtepi32_pd(_mm_cvtepi16_epi32(y16));
+      const __m256d area = _mm256_blendv_pd(
+         _mm256_andnot_pd(sign, _mm256_add_pd(_mm256_mul_pd(va, y), _mm256_add_pd(_mm256_mul_pd(vb, vj), vc))),
+         none, _mm256_cmp_pd(y, missing, _CMP_EQ_OQ));
+      const __m256d greater = _mm256_cmp_pd(area, best, _CMP_GT_OQ);
+      best = _mm256_blendv_pd(best, area, greater);
+      best_j = _mm256_blendv_pd(best_j, vj, greater);
+      vj = _mm256_add_pd(vj, step);
+   }
+
+   double areas[4];
+   double indices[4];
+   _mm256_storeu_pd(areas, best);
+   _mm256_storeu_pd(indices, best_j);
+
+   double best_area = -1;
+   size_t result = 0;
+
+   for (int lane = 0; lane < 4; ++lane)
+   {
+      if (areas[lane] > best_area || (areas[lane] == best_area && (size_t)indices[lane] < result))
+      {
+         best_area = areas[lane];
+         result = (size_t)indices[lane];
+      }
+   }
+
+   for (; j < n; ++j)
+   {
+      if (v[j] == SERIES_MISSING) continue;
+      const double area = fabs(a * v[j] + (b * (double)j + c));
+
+      if (area > best_area)
+      {
+         best_area = area;
+         result = j;
+      }
+   }
+
+   return result;
+}
+
+#endif /* __x86_64__ */
+
+/********************************************************************************
+* open: ppnar en befintlig seriefil fr lsning. Antalet vrden i huvudet
+*       jmfrs med filens storlek genom division, s att ett korrupt huvud
+*       inte kan ge en storlek som svmmar ver och en fr liten mappning.
+*
+*       - path: Skvg till filen.
+********************************************************************************/
+bool series_file::open(const char* path)
+{
+   close();
+
+   const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+   struct stat st;
+   struct series_header header;
+
+   if (fd < 0 || fstat(fd, &st) != 0)
+   {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      if (fd >= 0) ::close(fd);
+      return false;
+   }
+
+   if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+       memcmp(header.magic, SERIES_MAGIC, sizeof(header.magic)) != 0 ||
+       header.version != SERIES_VERSION ||
+       (header.kind != SAMPLE_RAW_ADC && header.kind != SAMPLE_CENTI_DEGREES) ||
+       header.interval_ns <= 0 ||
+       (uint64_t)st.st_size < SERIES_HEADER_SIZE ||
+       header.count > ((uint64_t)st.st_size - SERIES_HEADER_SIZE) / sizeof(int16_t))
+   {
+      fprintf(stderr, "%s: Ingen giltig seriefil!\n", path);
+      ::close(fd);
+      return false;
+   }
+
+   const size_t size = SERIES_HEADER_SIZE + header.count * sizeof(int16_t);
+   void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+   ::close(fd);
+
+   if (map == MAP_FAILED)
+   {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      return false;
+   }
+
+   madvise(map, size, MADV_SEQUENTIAL);
+   map_ = (uint8_t*)map;
+   map_size_ = size;
+   kind_ = (enum sample_kind)header.kind;
+   count_ = header.count;
+   start_ns_ = header.start_ns;
+   interval_ns_ = header.interval_ns;
+   return true;
+}
+
+/********************************************************************************
+* create: Skapar en seriefil med plats fr count vrden.
+*
+*         - path       : Skvg till filen.
+*         - kind       : Typ av vrden.
+*         - count      : Antal vrden.
+*         - start_ns   : Tidsstmpel fr frsta vrdet.
+*         - interval_ns: Tid mellan tv vrden.
+********************************************************************************/
+bool series_file::create(const char* path,
+                         const enum sample_kind kind,
+                         const uint64_t count,
+                         const int64_t start_ns,
+                         const int64_t interval_ns)
+{
+   close();
+
+   if (interval_ns <= 0 || count > (SIZE_MAX - SERIES_HEADER_SIZE) / sizeof(int16_t))
+   {
+      fprintf(stderr, "%s: Ogiltigt antal vrden eller intervall!\n", path);
+      return false;
+   }
+
+   const size_t size = SERIES_HEADER_SIZE + count * sizeof(int16_t);
+   const int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+   if (fd < 0 || ftruncate(fd, (off_t)size) != 0)
+   {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      if (fd >= 0) ::close(fd);
+      return false;
+   }
+
+   void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   ::close(fd);
+
+   if (map == MAP_FAILED)
+   {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      return false;
+   }
+
+   struct series_header header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, SERIES_MAGIC, sizeof(header.magic));
+   header.version = SERIES_VERSION;
+   header.kind = (uint32_t)kind;
+   header.count = count;
+   header.start_ns = start_ns;
+   header.interval_ns = interval_ns;
+   memcpy(map, &header, sizeof(header));
+
+   map_ = (uint8_t*)map;
+   map_size_ = size;
+   kind_ = kind;
+   count_ = count;
+   start_ns_ = start_ns;
+   interval_ns_ = interval_ns;
+   return true;
+}
+
+/********************************************************************************
+* close: Tar bort mappningen.
+********************************************************************************/
+void series_file::close(void)
+{
+   if (map_) munmap(map_, map_size_);
+   map_ = nullptr;
+   map_size_ = 0;
+   count_ = 0;
+   return;
+}
+
+/********************************************************************************
+* series_best_isa: Returnerar den bsta instruktionsuppsttning som
+*                  processorn stder. SSE2 ingr i alla x86-64-processorer.
+********************************************************************************/
+enum series_isa series_best_isa(void)
+{
+#if defined(__x86_64__)
+   return __builtin_cpu_supports("avx2") ? SERIES_ISA_AVX2 : SERIES_ISA_SSE2;
+#else
+   return SERIES_ISA_SCALAR;
+#endif
+}
+
+/********************************************************************************
+* series_isa_name: Returnerar namnet p angiven instruktionsuppsttning.
+********************************************************************************/
+const char* series_isa_name(const enum series_isa isa)
+{
+   switch (isa)
+   {
+   case SERIES_ISA_AVX2: return "AVX2";
+   case SERIES_ISA_SSE2: return "SSE2";
+   default: return "skalr";
+   }
+}
+
+/********************************************************************************
+* series_range_stats: Delar upp intervallet mellan trdarna, berknar
+*                     delresultat med vald krna och slr ihop dem.
+*
+*                     - v      : Pekare till frsta vrdet.
+*                     - n      : Antal vrden.
+*                     - threads: Antal trdar (0 = en per processorkrna).
+*                     - isa    : Instruktionsuppsttning.
+********************************************************************************/
+struct series_stats series_range_stats(const int16_t* v,
+                                       const size_t n,
+                                       const unsigned threads,
+                                       const enum series_isa isa)
+{
+   const stats_kernel kernel = select_stats_kernel(isa);
+   const unsigned parts = thread_count(n, threads);
+   std::vector<struct series_stats> partial(parts);
+
+   parallel_for(n, parts, [&](const size_t begin, const size_t end, const unsigned part)
+   {
+      partial[part] = kernel(v + begin, end - begin);
+   });
+
+   struct series_stats s = empty_stats();
+
+   for (const struct series_stats& p : partial)
+   {
+      merge_stats(s, p);
+   }
+
+   return s;
+}
+
+/********************************************************************************
+* series_downsample: Berknar min, max och summa per hink. Finns fler hinkar
+*                    n trdar frdelas hinkarna mellan trdarna, annars
+*                    delas varje hink upp mellan trdarna.
+*
+*                    - v         : Pekare till frsta vrdet.
+*                    - n         : Antal vrden.
+*                    - bucket_len: Antal vrden per hink.
+*                    - out       : Lagringsplats fr resultatet per hink.
+*                    - threads   : Antal trdar (0 = en per processorkrna).
+*                    - isa       : Instruktionsuppsttning.
+********************************************************************************/
+void series_downsample(const int16_t* v,
+                       const size_t n,
+                       const size_t bucket_len,
+                       struct series_stats* out,
+                       const unsigned threads,
+                       const enum series_isa isa)
+{
+   if (bucket_len == 0) return;
+
+   const stats_kernel kernel = select_stats_kernel(isa);
+   const size_t buckets = (n + bucket_len - 1) / bucket_len;
+   const unsigned parts = thread_count(n, threads);
+
+   if (buckets < parts)
+   {
+      for (size_t b = 0; b < buckets; ++b)
+      {
+         const size_t begin = b * bucket_len;
+         out[b] = series_range_stats(v + begin, std::min(bucket_len, n - begin), threads, isa);
+      }
+
+      return;
+   }
+
+   parallel_for(buckets, parts, [&](const size_t first, const size_t last, const unsigned)
+   {
+      for (size_t b = first; b < last; ++b)
+      {
+         const size_t begin = b * bucket_len;
+         out[b] = kernel(v + begin, std::min(bucket_len, n - begin));
+      }
+   });
+
+   return;
+}
+
+/********************************************************************************
+* series_lttb: Largest-Triangle-Three-Buckets.
+*
+*              1. Saknade vrden i brjan och slutet tas bort, s att frsta
+*                 och sista punkten finns. Dessa vljs alltid. vriga punkter
+*                 delas in i points - 2 hinkar, dr hink b brjar p index
+*                 b * (n - 2) / (points - 2) + 1. Grnserna berknas med
+*                 heltal, eftersom ett avrundat flyttal kan hamna under
+*                 en grns och flytta punkter mellan hinkarna. Hinkarna r
+*                 drmed lika breda i tid, ven dr vrden saknas.
+*
+*              2. Medelpunkten fr varje hink berknas i frvg med
+*                 summakrnan, frdelat mellan trdarna. Saknas vrden i en
+*                 hink berknas medelpunktens x frn de vrden som finns.
+*
+*              3. Hink fr hink vljs den punkt som bildar strst triangel
+*                 med fregende vald punkt och medelpunkten i nsta hink
+*                 som har vrden (eller sista punkten). Arean r linjr i
+*                 punktens x och y, s skningen blir en vektoriserbar
+*                 argmax ver |a * y + b * j + c|. Hinkar utan vrden hoppas
+*                 ver.
+*
+*              - v      : Pekare till frsta vrdet.
+*              - n      : Antal vrden.
+*              - points : nskat antal punkter (minst 3).
+*              - out    : Lagringsplats fr points index.
+*              - threads: Antal trdar (0 = en per processorkrna).
+*              - isa    : Instruktionsuppsttning.
+********************************************************************************/
+size_t series_lttb(const int16_t* v,
+                   const size_t n,
+                   const size_t points,
+                   uint64_t* out,
+                   const unsigned threads,
+                   const enum series_isa isa)
+{
+   size_t head = 0;
+   size_t tail = n;
+
+   while (head < tail && v[head] == SERIES_MISSING) ++head;
+   while (tail > head && v[tail - 1] == SERIES_MISSING) --tail;
+   if (head == tail) return 0;
+
+   if (head > 0 || tail < n)
+   {
+      const size_t count = series_lttb(v + head, tail - head, points, out, threads, isa);
+
+      for (size_t i = 0; i < count; ++i)
+      {
+         out[i] += head;
+      }
+
+      return count;
+   }
+
+   if (points >= n)
+   {
+      size_t count = 0;
+
+      for (size_t i = 0; i < n; ++i)
+      {
+         if (v[i] != SERIES_MISSING) out[count++] = i;
+      }
+
+      return count;
+   }
+
+   if (points < 3)
+   {
+      if (points > 1) out[0] = 0;
+      if (points > 0) out[points - 1] = n - 1;
+      return points;
+   }
+
+   const size_t buckets = points - 2;
+   const stats_kernel kernel = select_stats_kernel(isa);
+   std::vector<double> avg_x(buckets + 1);
+   std::vector<double> avg_y(buckets + 1);
+   std::vector<uint64_t> present(buckets + 1);
+   std::vector<size_t> next(buckets);
+
+   auto bucket_begin = [&](const size_t b) { return b * (n - 2) / buckets + 1; };
+
+   parallel_for(buckets, thread_count(n, threads), [&](const size_t first, const size_t last, const unsigned)
+   {
+      for (size_t b = first; b < last; ++b)
+      {
+         const size_t begin = bucket_begin(b);
+         const size_t end = bucket_begin(b + 1);
+         const struct series_stats s = kernel(v + begin, end - begin);
+         present[b] = s.count;
+         avg_y[b] = s.count ? (double)s.sum / s.count : 0;
+         avg_x[b] = (begin + (end - 1)) / 2.0;
+
+         if (s.count > 0 && s.count < end - begin)
+         {
+            double sum_x = 0;
+
+            for (size_t j = begin; j < end; ++j)
+            {
+               if (v[j] != SERIES_MISSING) sum_x += (double)j;
+            }
+
+            avg_x[b] = sum_x / s.count;
+         }
+      }
+   });
+
+   avg_x[buckets] = (double)(n - 1);
+   avg_y[buckets] = v[n - 1];
+   present[buckets] = 1;
+
+   for (size_t b = buckets, following = buckets; b-- > 0;)
+   {
+      next[b] = following;
+      if (present[b] > 0) following = b;
+   }
+
+   size_t selected = 0;
+   size_t count = 0;
+   out[count++] = 0;
+
+   for (size_t b = 0; b < buckets; ++b)
+   {
+      if (present[b] == 0) continue;
+
+      const size_t begin = bucket_begin(b);
+      const size_t end = bucket_begin(b + 1);
+      const double ax = (double)selected;
+      const double ay = v[selected];
+      const double a = ax - avg_x[next[b]];
+      const double slope = avg_y[next[b]] - ay;
+      const double c = -a * ay - ax * slope + slope * (double)begin;
+
+#if defined(__x86_64__)
+      const size_t j = isa >= SERIES_ISA_AVX2 && series_best_isa() == SERIES_ISA_AVX2 ?
+         argmax_area_avx2(v + begin, end - begin, a, slope, c) :
+         argmax_area_scalar(v + begin, end - begin, a, slope, c);
+#else
+      const size_t j = argmax_area_scalar(v + begin, end - begin, a, slope, c);
+#endif
+
+      selected = begin + j;
+      out[count++] = selected;
+   }
+
+   out[count++] = n - 1;
+   return count;
+}
+
+/********************************************************************************
+* series_codes_to_centi: Omvandlar AD-resultat till centigrader via en
+*                        uppslagstabell med ett vrde per mjligt resultat,
+*                        berknad med tmp36_code_to_centi. Eftersom AD-
+*                        omvandlaren bara har 1024 mjliga resultat blir
+*                        tabellen exakt och ryms i L1-cachen. Temperaturer
+*                        ver SERIES_VALUE_MAX centigrader (AD-resultat
+*                        ver cirka 875) begrnsas i stllet fr att sl
+*                        runt i int16, och SERIES_MISSING behlls.
+*
+*                        - codes  : Pekare till AD-resultaten.
+*                        - out    : Lagringsplats fr n vrden.
+*                        - n      : Antal vrden.
+*                        - threads: Antal trdar (0 = en per processorkrna).
+********************************************************************************/
+void series_codes_to_centi(const uint16_t* codes,
+                           int16_t* out,
+                           const size_t n,
+                           const unsigned threads)
+{
+   static const struct centi_table
+   {
+      int16_t entry[(int)TMP36_ADC_MAX + 1];
+
+      centi_table(void)
+      {
+         for (int code = 0; code <= (int)TMP36_ADC_MAX; ++code)
+         {
+            entry[code] = (int16_t)std::min(tmp36_code_to_centi((uint16_t)code), (int32_t)SERIES_VALUE_MAX);
+         }
+      }
+   } table;
+
+   parallel_for(n, thread_count(n, threads), [&](const size_t begin, const size_t end, const unsigned)
+   {
+      for (size_t i = begin; i < end; ++i)
+      {
+         out[i] = codes[i] == (uint16_t)SERIES_MISSING ? SERIES_MISSING :
+                  table.entry[std::min(codes[i], (uint16_t)TMP36_ADC_MAX)];
+      }
+   });
+
+   return;
+}
@@ -0,0 +1,216 @@
+/********************************************************************************
+* series.h: Frgor och nedsampling ver inspelade temperaturserier.
+*
+*           En seriefil bestr av ett huvud om SERIES_HEADER_SIZE byte fljt
+*           av count vrden om 16 bitar vardera, antingen ra AD-resultat
+*           (uint16, 0 - 1023) eller hundradels grader Celcius (int16).
+*           Vrde i hr till tidsfacket start_ns + i * interval_ns, s
+*           tidsintervall motsvarar indexintervall.
+*
+*           Inspelad utdata r inte jmnt frdelad: interrupts.c skriver ut
+*           vid varje knapptryckning och nollstller timern, och avbrott
+*           ger hl. series_import placerar drfr varje rad frn en
+*           kolumnfil i nrmaste tidsfack och markerar fack utan mtning
+*           med SERIES_MISSING. Samtliga krnor hoppar ver saknade vrden.
+*
+*           AD-resultat ryms i int16 och behandlas drfr med samma krnor
+*           som centigrader. Eftersom verfringsfunktionen i
+*           tmp36_get_temperature r linjr kan min, max och medelvrde
+*           berknas direkt p AD-resultaten och omvandlas i efterhand med
+*           series_to_celcius, utan att varje vrde behver omvandlas.
+*
+*           Krnorna finns i tre varianter (skalr, SSE2 och AVX2) och vljs
+*           vid krning med series_best_isa. Stora serier delas upp mellan
+*           flera trdar.
+********************************************************************************/
+#ifndef SERIES_H_
+#define SERIES_H_
+
+/* Inkluderingsdirektiv: */
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sample.h"
+
+/* Makrodefinitioner: */
+#define SERIES_HEADER_SIZE 4096    /* Huvudets storlek i byte (en sida). */
+#define SERIES_MISSING INT16_MIN   /* Markerar ett tidsfack utan mtning. */
+#define SERIES_VALUE_MAX INT16_MAX /* Strsta lagringsbara vrde. */
+
+/********************************************************************************
+* series_isa: Enumeration fr val av instruktionsuppsttning.
+********************************************************************************/
+enum series_isa
+{
+   SERIES_ISA_SCALAR, /* Skalr referensimplementation. */
+   SERIES_ISA_SSE2,   /* 128-bitars vektorer (alla x86-64-processorer). */
+   SERIES_ISA_AVX2    /* 256-bitars vektorer. */
+};
+
+/********************************************************************************
+* series_stats: Min, max och summa fr ett intervall, i filens enhet.
+*               Saknade vrden ingr inte. r count noll saknar min och max
+*               betydelse.
+********************************************************************************/
+struct series_stats
+{
+   int32_t min;    /* Minsta vrde. */
+   int32_t max;    /* Strsta vrde. */
+   int64_t sum;    /* Summan av alla vrden. */
+   uint64_t count; /* Antal vrden som inte saknas. */
+};
+
+/********************************************************************************
+* series_file: Minnesmappad seriefil.
+********************************************************************************/
+class series_file
+{
+public:
+   series_file(void) = default;
+   series_file(const series_file&) = delete;
+   series_file& operator=(const series_file&) = delete;
+   ~series_file(void) { close(); }
+
+   /********************************************************************************
+   * open: ppnar en befintlig seriefil fr lsning. Returnerar false vid fel.
+   *
+   *       - path: Skvg till filen.
+   ********************************************************************************/
+   bool open(const char* path);
+
+   /********************************************************************************
+   * create: Skapar en seriefil med plats fr count vrden, som fylls i via
+   *         writable_values med mtvrden eller SERIES_MISSING. Returnerar
+   *         false vid fel.
+   *
+   *         - path       : Skvg till filen.
+   *         - kind       : Typ av vrden.
+   *         - count      : Antal vrden.
+   *         - start_ns   : Tidsstmpel fr frsta vrdet.
+   *         - interval_ns: Tid mellan tv vrden.
+   ********************************************************************************/
+   bool create(const char* path,
+               const enum sample_kind kind,
+               const uint64_t count,
+               const int64_t start_ns,
+               const int64_t interval_ns);
+
+   /********************************************************************************
+   * close: Stnger filen. Skrivna vrden nr disken via sidcachen.
+   ********************************************************************************/
+   void close(void);
+
+   const int16_t* values(void) const { return (const int16_t*)(map_ + SERIES_HEADER_SIZE); }
+   int16_t* writable_values(void) { return (int16_t*)(map_ + SERIES_HEADER_SIZE); }
+   enum sample_kind kind(void) const { return kind_; }
+   uint64_t count(void) const { return count_; }
+   int64_t start_ns(void) const { return start_ns_; }
+   int64_t interval_ns(void) const { return interval_ns_; }
+
+private:
+   uint8_t* map_ = nullptr;                   /* Mappning av hela filen. */
+   size_t map_size_ = 0;                      /* Mappningens storlek i byte. */
+   enum sample_kind kind_ = SAMPLE_RAW_ADC;   /* Typ av vrden. */
+   uint64_t count_ = 0;                       /* Antal vrden. */
+   int64_t start_ns_ = 0;                     /* Tidsstmpel fr frsta vrdet. */
+   int64_t interval_ns_ = 0;                  /* Tid mellan tv vrden. */
+};
+
+/********************************************************************************
+* series_best_isa: Returnerar den bsta instruktionsuppsttning som
+*                  processorn stder.
+********************************************************************************/
+enum series_isa series_best_isa(void);
+
+/********************************************************************************
+* series_isa_name: Returnerar namnet p angiven instruktionsuppsttning.
+********************************************************************************/
+const char* series_isa_name(const enum series_isa isa);
+
+/********************************************************************************
+* series_to_celcius: Omvandlar ett vrde (eller medelvrde) i filens enhet
+*                    till grader Celcius.
+*
+*                    - kind : Typ av vrden.
+*                    - value: Vrdet som ska omvandlas.
+********************************************************************************/
+static inline double series_to_celcius(const enum sample_kind kind, const double value)
+{
+   if (kind == SAMPLE_CENTI_DEGREES) return value / 100;
+   return 100 * (value / TMP36_ADC_MAX * TMP36_VCC) - 50;
+}
+
+/********************************************************************************
+* series_range_stats: Returnerar min, max och summa fr angivet intervall.
+*
+*                     - v      : Pekare till frsta vrdet.
+*                     - n      : Antal vrden.
+*                     - threads: Antal trdar (0 = en per processorkrna).
+*                     - isa    : Instruktionsuppsttning.
+********************************************************************************/
+struct series_stats series_range_stats(const int16_t* v,
+                                       const size_t n,
+                                       const unsigned threads,
+                                       const enum series_isa isa);
+
+/********************************************************************************
+* series_downsample: Delar in serien i hinkar om bucket_len vrden (den sista
+*                    kan vara kortare) och berknar min, max och summa per
+*                    hink. out mste rymma (n + bucket_len - 1) / bucket_len
+*                    element. En tidsbredd w i ns motsvarar
+*                    bucket_len = w / interval_ns. Hinkar dr alla vrden
+*                    saknas fr count noll.
+*
+*                    - v         : Pekare till frsta vrdet.
+*                    - n         : Antal vrden.
+*                    - bucket_len: Antal vrden per hink.
+*                    - out       : Lagringsplats fr resultatet per hink.
+*                    - threads   : Antal trdar (0 = en per processorkrna).
+*                    - isa       : Instruktionsuppsttning.
+********************************************************************************/
+void series_downsample(const int16_t* v,
+                       const size_t n,
+                       const size_t bucket_len,
+                       struct series_stats* out,
+                       const unsigned threads,
+                       const enum series_isa isa);
+
+/********************************************************************************
+* series_lttb: Vljer ut hgst points punkter med Largest-Triangle-Three-
+*              Buckets, som bevarar kurvans form vid plottning. Index fr de
+*              valda punkterna lagras i out och antalet returneras. Saknade
+*              vrden vljs aldrig, s hinkar som saknar vrden helt ger
+*              frre punkter.
+*
+*              - v      : Pekare till frsta vrdet.
+*              - n      : Antal vrden.
+*              - points : nskat antal punkter (minst 3).
+*              - out    : Lagringsplats fr points index.
+*              - threads: Antal trdar (0 = en per processorkrna).
+*              - isa    : Instruktionsuppsttning.
+********************************************************************************/
+size_t series_lttb(const int16_t* v,
+                   const size_t n,
+                   const size_t points,
+                   uint64_t* out,
+                   const unsigned threads,
+                   const enum series_isa isa);
+
+/********************************************************************************
+* series_codes_to_centi: Omvandlar AD-resultat till hundradels grader Celcius
+*                        med samma verfringsfunktion som
+*                        tmp36_get_temperature. Resultat ver 1023 begrnsas,
+*                        liksom temperaturer ver SERIES_VALUE_MAX
+*                        centigrader. SERIES_MISSING behlls.
+*
+*                        - codes  : Pekare till AD-resultaten.
+*                        - out    : Lagringsplats fr n vrden.
+*                        - n      : Antal vrden.
+*                        - threads: Antal trdar (0 = en per processorkrna).
+********************************************************************************/
+void series_codes_to_centi(const uint16_t* codes,
+                           int16_t* out,
+                           const size_t n,
+                           const unsigned threads);
+
+#endif /* SERIES_H_ */
@@ -0,0 +1,143 @@
+/********************************************************************************
+* series_import.cpp: Skapar en seriefil (se series.h) frn en sensors rader i
+*                    en kolumnfil som skrivits av collector.
+*
+*                    Anvndning:
+*
+*                    series_import [-s sensor] [-p period_ms] <kolumnfil> <seriefil>
+*
+*                    - sensor   : Sensor-id som ska importeras, frvalt 0.
+*                    - period_ms: Tidsfackens bredd, frvalt
+*                                 TMP36_PRINT_PERIOD_MS (en minut).
+*
+*                    Mikrodatorns utskrifter r inte jmnt frdelade: varje
+*                    knapptryckning ger en extra utskrift och nollstller
+*                    timern, och avbrott ger hl. Varje rad placeras drfr i
+*                    det fack vars tid ligger nrmast radens tidsstmpel.
+*                    Hamnar flera rader i samma fack lagras deras medelvrde,
+*                    och fack utan rader markeras med SERIES_MISSING. Tiden
+*                    fr varje vrde blir drmed korrekt inom en halv period.
+*
+*                    Seriefilen lagrar centigrader som int16, s temperaturer
+*                    utanfr +-SERIES_VALUE_MAX centigrader begrnsas.
+********************************************************************************/
+#include "column_store.h"
+#include "series.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+/********************************************************************************
+* main: Lser kolumnfilen tv gnger, frst fr att hitta frsta och sista
+*       tidsstmpeln fr sensorn och drefter fr att summera raderna per
+*       tidsfack, varefter seriefilen skrivs och en sammanfattning skrivs ut.
+********************************************************************************/
+int main(int argc, char** argv)
+{
+   long sensor = 0;
+   long period_ms = TMP36_PRINT_PERIOD_MS;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "s:p:")) != -1)
+   {
+      switch (opt)
+      {
+      case 's': sensor = strtol(optarg, nullptr, 10); break;
+      case 'p': period_ms = strtol(optarg, nullptr, 10); break;
+      default: optind = argc + 1; break;
+      }
+   }
+
+   if (optind + 2 != argc || sensor < 0 || sensor > 0xFFFF || period_ms <= 0)
+   {
+      fprintf(stderr, "Anvndning: %s [-s sensor] [-p period_ms] <kolumnfil> <seriefil>\n", argv[0]);
+      return 2;
+   }
+
+   column_store store;
+   if (!store.open(argv[optind], false)) return 1;
+
+   int64_t first_ns = INT64_MAX;
+   int64_t last_ns = INT64_MIN;
+   uint64_t rows = 0;
+
+   for (size_t b = 0; b < store.block_count(); ++b)
+   {
+      const uint32_t len = store.block_length(b);
+      const int64_t* timestamps = store.timestamps(b);
+      const uint16_t* sensors = store.sensors(b);
+
+      for (uint32_t i = 0; i < len; ++i)
+      {
+         if (sensors[i] != (uint16_t)sensor) continue;
+         if (timestamps[i] < first_ns) first_ns = timestamps[i];
+         if (timestamps[i] > last_ns) last_ns = timestamps[i];
+         ++rows;
+      }
+   }
+
+   if (rows == 0)
+   {
+      fprintf(stderr, "%s: Inga rader fr sensor %ld!\n", argv[optind], sensor);
+      return 1;
+   }
+
+   const int64_t interval_ns = (int64_t)period_ms * 1000000LL;
+   const uint64_t slots = ((uint64_t)last_ns - (uint64_t)first_ns + interval_ns / 2) / interval_ns + 1;
+   std::vector<int64_t> sums(slots);
+   std::vector<uint32_t> counts(slots);
+
+   for (size_t b = 0; b < store.block_count(); ++b)
+   {
+      const uint32_t len = store.block_length(b);
+      const int64_t* timestamps = store.timestamps(b);
+      const int32_t* values = store.values(b);
+      const uint16_t* sensors = store.sensors(b);
+
+      for (uint32_t i = 0; i < len; ++i)
+      {
+         if (sensors[i] != (uint16_t)sensor) continue;
+         const uint64_t slot = ((uint64_t)timestamps[i] - (uint64_t)first_ns + interval_ns / 2) / interval_ns;
+         sums[slot] += values[i];
+         ++counts[slot];
+      }
+   }
+
+   series_file series;
+   if (!series.create(argv[optind + 1], SAMPLE_CENTI_DEGREES, slots, first_ns, interval_ns)) return 1;
+
+   int16_t* v = series.writable_values();
+   uint64_t empty = 0;
+   uint64_t limited = 0;
+
+   for (uint64_t i = 0; i < slots; ++i)
+   {
+      if (counts[i] == 0)
+      {
+         v[i] = SERIES_MISSING;
+         ++empty;
+         continue;
+      }
+
+      const long long mean = llround((double)sums[i] / counts[i]);
+
+      if (mean > SERIES_VALUE_MAX || mean < -SERIES_VALUE_MAX)
+      {
+         v[i] = mean > 0 ? SERIES_VALUE_MAX : -SERIES_VALUE_MAX;
+         ++limited;
+      }
+      else
+      {
+         v[i] = (int16_t)mean;
+      }
+   }
+
+   series.close();
+   printf("%llu rader, %llu fack om %ld ms, %llu saknade, %llu sammanslagna, %llu begrnsade.\n",
+          (unsigned long long)rows, (unsigned long long)slots, period_ms, (unsigned long long)empty,
+          (unsigned long long)(rows - (slots - empty)), (unsigned long long)limited);
+   return 0;
+}
@@ -0,0 +1,104 @@
+/********************************************************************************
+* series_query.cpp: Skriver ut min, max och medelvrde fr en seriefil samt
+*                   en nedsamplad kurva fr plottning.
+*
+*                   Anvndning:
+*
+*                   series_query [-b bredd_s] [-l punkter] [-t trdar] <fil>
+*
+*                   - bredd_s: Skriv ut min/max/medel per tidshink om angivet
+*                              antal sekunder.
+*                   - punkter: Skriv ut en LTTB-kurva med angivet antal punkter.
+*                   - trdar : Antal trdar, frvalt en per processorkrna.
+*
+*                   Kurvor skrivs ut som "<tid_ns> <vrden...>" i grader Celcius,
+*                   dr tiden fr en hink r dess brjan. Hinkar utan vrden
+*                   skrivs inte ut. Seriefiler frn inspelad data skapas med
+*                   series_import.
+********************************************************************************/
+#include "series.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+/********************************************************************************
+* main: ppnar seriefilen och skriver ut de efterfrgade resultaten.
+********************************************************************************/
+int main(int argc, char** argv)
+{
+   double bucket_s = 0;
+   size_t points = 0;
+   unsigned threads = 0;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "b:l:t:")) != -1)
+   {
+      switch (opt)
+      {
+      case 'b': bucket_s = strtod(optarg, nullptr); break;
+      case 'l': points = strtoull(optarg, nullptr, 10); break;
+      case 't': threads = (unsigned)strtoul(optarg, nullptr, 10); break;
+      default: optind = argc + 1; break;
+      }
+   }
+
+   if (optind + 1 != argc || bucket_s < 0)
+   {
+      fprintf(stderr, "Anvndning: %s [-b bredd_s] [-l punkter] [-t trdar] <fil>\n", argv[0]);
+      return 2;
+   }
+
+   series_file file;
+   if (!file.open(argv[optind])) return 1;
+
+   const int16_t* v = file.values();
+   const size_t n = file.count();
+   const enum series_isa isa = series_best_isa();
+   const enum sample_kind kind = file.kind();
+   const struct series_stats all = series_range_stats(v, n, threads, isa);
+
+   if (all.count == 0)
+   {
+      printf("Serien r tom.\n");
+      return 0;
+   }
+
+   printf("# %zu tidsfack, %llu med vrden: min %.2f, max %.2f, medel %.3f grader Celcius\n",
+          n, (unsigned long long)all.count, series_to_celcius(kind, all.min), series_to_celcius(kind, all.max),
+          series_to_celcius(kind, (double)all.sum / all.count));
+
+   if (bucket_s > 0)
+   {
+      size_t bucket_len = (size_t)(bucket_s * 1e9 / file.interval_ns());
+      if (bucket_len == 0) bucket_len = 1;
+
+      std::vector<struct series_stats> buckets((n + bucket_len - 1) / bucket_len);
+      series_downsample(v, n, bucket_len, buckets.data(), threads, isa);
+
+      for (size_t b = 0; b < buckets.size(); ++b)
+      {
+         if (buckets[b].count == 0) continue;
+         printf("%lld %.2f %.2f %.3f\n",
+                (long long)(file.start_ns() + (int64_t)(b * bucket_len) * file.interval_ns()),
+                series_to_celcius(kind, buckets[b].min), series_to_celcius(kind, buckets[b].max),
+                series_to_celcius(kind, (double)buckets[b].sum / buckets[b].count));
+      }
+   }
+
+   if (points > 0)
+   {
+      std::vector<uint64_t> selected(points);
+      const size_t count = series_lttb(v, n, points, selected.data(), threads, isa);
+
+      for (size_t i = 0; i < count; ++i)
+      {
+         printf("%lld %.2f\n",
+                (long long)(file.start_ns() + (int64_t)selected[i] * file.interval_ns()),
+                series_to_celcius(kind, v[selected[i]]));
+      }
+   }
+
+   return 0;
+}
@@ -0,0 +1,382 @@
+/********************************************************************************
+* stream_parser.cpp: Innehller definitioner fr tolkning av den seriella
+*                    strmmen frn mikrodatorn.
+********************************************************************************/
+#include "stream_parser.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+/********************************************************************************
+* crc8_table: Uppslagstabell fr CRC-8 med polynom 0x07, berknad vid start.
+********************************************************************************/
+static const struct crc8_table
+{
+   uint8_t entry[256];
+
+   crc8_table(void)
+   {
+      for (int i = 0; i < 256; ++i)
+      {
+         uint8_t crc = (uint8_t)i;
+
+         for (int bit = 0; bit < 8; ++bit)
+         {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+         }
+
+         entry[i] = crc;
+      }
+   }
+} crc8_lookup;
+
+/********************************************************************************
+* parse_int: Tolkar ett signerat heltal om hgst fem siffror med start p
+*            index i. Vid lyckad tolkning pekar i p frsta tecknet efter
+*            talet och true returneras.
+*
+*            - p  : Pekare till raden.
+*            - len: Radens lngd.
+*            - i  : Aktuellt index, uppdateras.
+*            - num: Lagringsplats fr det tolkade talet.
+********************************************************************************/
+static bool parse_int(const uint8_t* p, const size_t len, size_t& i, int32_t& num)
+{
+   const bool negative = i < len && p[i] == '-';
+   if (negative) ++i;
+
+   const size_t start = i;
+   int32_t value = 0;
+
+   while (i < len && p[i] >= '0' && p[i] <= '9' && i - start < 5)
+   {
+      value = value * 10 + (p[i++] - '0');
+   }
+
+   if (i == start) return false;
+   num = negative ? -value : value;
+   return true;
+}
+
+/********************************************************************************
+* parse_line: Tolkar en textrad frn tmp36_print_temperature och returnerar
+*             true vid lyckad tolkning.
+*
+*             Observera att serial_print_double skriver ut decimaldelen som
+*             ett eget heltal utan inledande nollor, s 23.05 skrivs ut som
+*             "23.5". Mellan -1 och 0 r heltalsdelen noll och decimaldelen
+*             blir (int32_t)(-47 + 0.5) = -46, s -0.47 skrivs ut som
+*             "0.-46". Raden tolkas drfr tillbaka som heltalsdel * 100 plus
+*             decimaldelen (med heltalsdelens tecken), vilket ger samma vrde
+*             som format_line berknar fr den utskrivna raden.
+*
+*             - p  : Pekare till radens frsta tecken.
+*             - len: Radens lngd exklusive nyradstecknet.
+*             - r  : Lagringsplats fr den tolkade posten.
+********************************************************************************/
+static bool parse_line(const uint8_t* p, size_t len, record& r)
+{
+   static const char prefix[] = "Temperature: ";
+   static const char suffix[] = " degrees";
+   const size_t prefix_len = sizeof(prefix) - 1;
+   const size_t suffix_len = sizeof(suffix) - 1;
+
+   if (len > 0 && p[len - 1] == '\r') --len;
+   if (len < prefix_len || memcmp(p, prefix, prefix_len) != 0) return false;
+
+   size_t i = prefix_len;
+   int32_t integer = 0;
+   int32_t decimal = 0;
+
+   if (!parse_int(p, len, i, integer)) return false;
+   if (i >= len || p[i++] != '.') return false;
+   if (!parse_int(p, len, i, decimal)) return false;
+   if (len - i < suffix_len || memcmp(p + i, suffix, suffix_len) != 0) return false;
+
+   r.sensor = 0;
+   r.has_seq = false;
+   r.seq = 0;
+   r.value_centi = integer * 100 + (integer < 0 ? -decimal : decimal);
+   return true;
+}
+
+/********************************************************************************
+* parse_frame: Avkodar en binr ram vars synkbyte och CRC redan har
+*              kontrollerats. Returnerar false vid oknd vrdetyp eller
+*              ogiltigt AD-resultat.
+*
+*              - p: Pekare till ramens frsta byte.
+*              - r: Lagringsplats fr den tolkade posten.
+********************************************************************************/
+static bool parse_frame(const uint8_t* p, record& r)
+{
+   const int16_t value = (int16_t)(p[6] | (p[7] << 8));
+
+   if (p[3] == SAMPLE_CENTI_DEGREES)
+   {
+      r.value_centi = value;
+   }
+   else if (p[3] == SAMPLE_RAW_ADC && value >= 0 && value <= (int16_t)TMP36_ADC_MAX)
+   {
+      r.value_centi = tmp36_code_to_centi((uint16_t)value);
+   }
+   else
+   {
+      return false;
+   }
+
+   r.sensor = p[2];
+   r.has_seq = true;
+   r.seq = (uint16_t)(p[4] | (p[5] << 8));
+   return true;
+}
+
+/********************************************************************************
+* frame_crc8: Returnerar CRC-8 (polynom 0x07) fr angiven data.
+*
+*             - data: Pekare till datan.
+*             - len : Antal byte.
+********************************************************************************/
+uint8_t frame_crc8(const uint8_t* data, const size_t len)
+{
+   uint8_t crc = 0;
+
+   for (size_t i = 0; i < len; ++i)
+   {
+      crc = crc8_lookup.entry[crc ^ data[i]];
+   }
+
+   return crc;
+}
+
+/********************************************************************************
+* frame_encode: Skriver en binr ram till angiven buffert, som mste rymma
+*               FRAME_SIZE byte.
+*
+*               - buf   : Bufferten som ramen skrivs till.
+*               - sensor: Sensor-id.
+*               - kind  : Typ av vrde.
+*               - seq   : Sekvensnummer.
+*               - value : Vrdet (centigrader eller AD-resultat).
+********************************************************************************/
+void frame_encode(uint8_t* buf,
+                  const uint8_t sensor,
+                  const enum sample_kind kind,
+                  const uint16_t seq,
+                  const int16_t value)
+{
+   buf[0] = FRAME_SYNC0;
+   buf[1] = FRAME_SYNC1;
+   buf[2] = sensor;
+   buf[3] = (uint8_t)kind;
+   buf[4] = (uint8_t)(seq & 0xFF);
+   buf[5] = (uint8_t)(seq >> 8);
+   buf[6] = (uint8_t)((uint16_t)value & 0xFF);
+   buf[7] = (uint8_t)((uint16_t)value >> 8);
+   buf[8] = frame_crc8(buf + 2, 6);
+   return;
+}
+
+/********************************************************************************
+* format_line: Skriver en rad exakt som tmp36_print_temperature skriver ut
+*              den. Heltals- och decimaldelen berknas som i
+*              serial_print_double och skrivs ut som tv heltal.
+*
+*              - buf        : Buffert om minst RECORD_MAX_LEN tecken.
+*              - celcius    : Temperaturen som ska skrivas ut.
+*              - value_centi: Lagringsplats fr det utskrivna vrdet.
+********************************************************************************/
+size_t format_line(char* buf, const double celcius, int32_t* value_centi)
+{
+   const int32_t integer = (int32_t)celcius;
+   int32_t decimal = 0;
+
+   if (integer >= 0)
+   {
+      decimal = (int32_t)((celcius - integer) * 100 + 0.5);
+   }
+   else
+   {
+      decimal = (int32_t)((integer - celcius) * 100 + 0.5);
+   }
+
+   *value_centi = integer * 100 + (integer < 0 ? -decimal : decimal);
+   return (size_t)snprintf(buf, RECORD_MAX_LEN, "Temperature: %d.%d degrees Celcius\n\r",
+                           integer, decimal);
+}
+
+/********************************************************************************
+* scan: Tolkar s mnga fullstndiga poster som mjligt ur angiven buffert
+*       och returnerar antalet frbrukade byte. Resterande byte utgr en
+*       ofullstndig post som r kortare n RECORD_MAX_LEN.
+*
+*       1. En synkbyte inleder en binr ram. r synkbyte tv eller CRC
+*          felaktig kastas en byte och skningen fortstter (omsynkronisering).
+*
+*       2. Vagnretur- och nyradstecken mellan poster hoppas ver, eftersom
+*          serial_print_string skickar "\n\r" efter varje rad.
+*
+*       3. vriga tecken inleder en textrad som avslutas med '\n'. En rad som
+*          inte gr att tolka kastas. En synkbyte frekommer aldrig i
+*          mikrodatorns text, s ptrffas en sdan fre nyradstecknet
+*          kastas raden direkt och skningen fortstter drifrn, s att en
+*          ram efter brus inte gr frlorad. Saknas bda inom RECORD_MAX_LEN
+*          byte kastas raden och resten av den hoppas ver, ven i senare
+*          anrop. Beslutet beror drmed bara p byten fram till frsta
+*          nyradstecken eller synkbyte, och resultatet blir detsamma oavsett
+*          hur strmmen delas upp i lsningar.
+*
+*       - p  : Pekare till bufferten.
+*       - n  : Antal byte i bufferten.
+*       - out: Vektor som tolkade poster lggs till i.
+********************************************************************************/
+size_t stream_parser::scan(const uint8_t* p, const size_t n, std::vector<record>& out)
+{
+   size_t i = 0;
+
+   while (i < n)
+   {
+      if (skip_line_)
+      {
+         while (i < n && p[i] != '\n' && p[i] != FRAME_SYNC0) ++i;
+         if (i == n) break;
+         if (p[i] == '\n') ++i;
+         skip_line_ = false;
+         continue;
+      }
+
+      const uint8_t c = p[i];
+
+      if (c == FRAME_SYNC0)
+      {
+         if (n - i < FRAME_SIZE)
+         {
+            if (n - i < 2 || p[i + 1] == FRAME_SYNC1) break;
+            ++dropped_bytes;
+            ++i;
+            continue;
+         }
+
+         record r;
+
+         if (p[i + 1] == FRAME_SYNC1 && frame_crc8(p + i + 2, 6) == p[i + 8])
+         {
+            if (parse_frame(p + i, r))
+            {
+               out.push_back(r);
+            }
+            else
+            {
+               ++bad_records;
+            }
+
+            i += FRAME_SIZE;
+         }
+         else
+         {
+            ++dropped_bytes;
+            ++i;
+         }
+
+         continue;
+      }
+
+      if (c == '\n' || c == '\r')
+      {
+         ++i;
+         continue;
+      }
+
+      const uint8_t* nl = (const uint8_t*)memchr(p + i, '\n', n - i);
+      const size_t line_len = nl ? (size_t)(nl - (p + i)) : n - i;
+      const uint8_t* sync = (const uint8_t*)memchr(p + i, FRAME_SYNC0, line_len);
+
+      if (sync)
+      {
+         ++bad_records;
+         i = (size_t)(sync - p);
+         continue;
+      }
+
+      if (!nl)
+      {
+         if (line_len >= RECORD_MAX_LEN)
+         {
+            ++bad_records;
+            skip_line_ = true;
+            i = n;
+         }
+
+         break;
+      }
+
+      record r;
+
+      if (line_len < RECORD_MAX_LEN && parse_line(p + i, line_len, r))
+      {
+         out.push_back(r);
+      }
+      else
+      {
+         ++bad_records;
+      }
+
+      i += line_len + 1;
+   }
+
+   return i;
+}
+
+/********************************************************************************
+* feed: Tolkar angiven data och lgger till fullstndiga poster sist i out.
+*
+*       1. Finns en ofullstndig post sedan fregende anrop fylls den p med
+*          ny data tills den antingen blir fullstndig eller datan tar slut.
+*          Detta r den enda kopieringen som sker och den rr hgst
+*          RECORD_MAX_LEN byte.
+*
+*       2. Resten av datan tolkas direkt i anroparens buffert.
+*
+*       3. En eventuell ofullstndig post i slutet sparas till nsta anrop.
+*
+*       - data: Pekare till mottagen data.
+*       - len : Antal byte i data.
+*       - out : Vektor som tolkade poster lggs till i.
+********************************************************************************/
+size_t stream_parser::feed(const uint8_t* data, const size_t len, std::vector<record>& out)
+{
+   const size_t records_before = out.size();
+   size_t offset = 0;
+
+   while (pending_len_ > 0 && offset < len)
+   {
+      const size_t old_len = pending_len_;
+      const size_t take = std::min(len - offset, sizeof(pending_) - old_len);
+      memcpy(pending_ + old_len, data + offset, take);
+
+      const size_t total = old_len + take;
+      const size_t used = scan(pending_, total, out);
+
+      if (used >= old_len)
+      {
+         offset += used - old_len;
+         pending_len_ = 0;
+      }
+      else
+      {
+         memmove(pending_, pending_ + used, total - used);
+         pending_len_ = total - used;
+         offset += take;
+      }
+   }
+
+   if (offset < len)
+   {
+      const size_t used = scan(data + offset, len - offset, out);
+      pending_len_ = len - offset - used;
+      memcpy(pending_, data + offset + used, pending_len_);
+   }
+
+   return out.size() - records_before;
+}
@@ -0,0 +1,106 @@
+/********************************************************************************
+* stream_parser.h: Inkrementell tolkning av den seriella strmmen frn
+*                  mikrodatorn. Tv format stds och kan blandas fritt:
+*
+*                  1. Textformatet frn tmp36_print_temperature, exempelvis
+*                     "Temperature: 23.47 degrees Celcius\n\r".
+*
+*                  2. Binra ramar om FRAME_SIZE byte:
+*
+*                     [0xA5][0x5A][sensor][typ][seq lo][seq hi][vrde lo]
+*                     [vrde hi][crc8],
+*
+*                     dr typ r en sample_kind, vrdet r ett 16-bitars
+*                     signerat heltal (little endian) och crc8 (polynom 0x07)
+*                     berknas ver byte 2 - 7.
+*
+*                  Data tolkas direkt i anroparens lsbuffert. Endast en
+*                  ofullstndig post i slutet av bufferten kopieras undan
+*                  till nsta anrop.
+********************************************************************************/
+#ifndef STREAM_PARSER_H_
+#define STREAM_PARSER_H_
+
+/* Inkluderingsdirektiv: */
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "sample.h"
+
+/* Makrodefinitioner: */
+#define FRAME_SYNC0 0xA5  /* Frsta synkbyten i en binr ram. */
+#define FRAME_SYNC1 0x5A  /* Andra synkbyten i en binr ram. */
+#define FRAME_SIZE 9      /* Storlek p en binr ram i byte. */
+#define RECORD_MAX_LEN 64 /* Lngsta tilltna post (rad eller ram) i byte. */
+
+/********************************************************************************
+* stream_parser: Tillstndsmaskin fr tolkning av en enskild seriell strm.
+*                Varje enhet har sin egen instans.
+********************************************************************************/
+class stream_parser
+{
+public:
+   /********************************************************************************
+   * feed: Tolkar angiven data och lgger till fullstndiga poster sist i out.
+   *       Returnerar antalet nya poster.
+   *
+   *       - data: Pekare till mottagen data.
+   *       - len : Antal byte i data.
+   *       - out : Vektor som tolkade poster lggs till i.
+   ********************************************************************************/
+   size_t feed(const uint8_t* data, const size_t len, std::vector<record>& out);
+
+   /********************************************************************************
+   * reset: Kastar eventuell ofullstndig post, exempelvis efter teranslutning.
+   ********************************************************************************/
+   void reset(void) { pending_len_ = 0; skip_line_ = false; }
+
+   uint64_t bad_records = 0;   /* Antal rader eller ramar som inte gick att tolka. */
+   uint64_t dropped_bytes = 0; /* Antal byte som kastades vid omsynkronisering. */
+
+private:
+   size_t scan(const uint8_t* p, const size_t n, std::vector<record>& out);
+
+   uint8_t pending_[RECORD_MAX_LEN]; /* Ofullstndig post frn fregende anrop. */
+   size_t pending_len_ = 0;         /* Antal byte i pending_. */
+   bool skip_line_ = false;         /* Indikerar ifall resten av en fr lng rad ska hoppas ver. */
+};
+
+/********************************************************************************
+* frame_crc8: Returnerar CRC-8 (polynom 0x07) fr angiven data.
+*
+*             - data: Pekare till datan.
+*             - len : Antal byte.
+********************************************************************************/
+uint8_t frame_crc8(const uint8_t* data, const size_t len);
+
+/********************************************************************************
+* frame_encode: Skriver en binr ram till angiven buffert, som mste rymma
+*               FRAME_SIZE byte. Anvnds av simulatorer och tester.
+*
+*               - buf   : Bufferten som ramen skrivs till.
+*               - sensor: Sensor-id.
+*               - kind  : Typ av vrde.
+*               - seq   : Sekvensnummer.
+*               - value : Vrdet (centigrader eller AD-resultat).
+********************************************************************************/
+void frame_encode(uint8_t* buf,
+                  const uint8_t sensor,
+                  const enum sample_kind kind,
+                  const uint16_t seq,
+                  const int16_t value);
+
+/********************************************************************************
+* format_line: Skriver en rad exakt som tmp36_print_temperature skriver ut
+*              den, inklusive "\n\r", och returnerar radens lngd. Det vrde
+*              i centigrader som raden motsvarar lagras i value_centi.
+*              Anvnds av simulatorer och prestandamtningar.
+*
+*              - buf        : Buffert om minst RECORD_MAX_LEN tecken.
+*              - celcius    : Temperaturen som ska skrivas ut.
+*              - value_centi: Lagringsplats fr det utskrivna vrdet.
+********************************************************************************/
+size_t format_line(char* buf, const double celcius, int32_t* value_centi);
+
+#endif /* STREAM_PARSER_H_ */
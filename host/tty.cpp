@@ -0,0 +1,45 @@
+/********************************************************************************
+* tty.cpp: Innehller definitioner fr instllning av seriella portar.
+********************************************************************************/
+#include "tty.h"
+
+/********************************************************************************
+* tty_baud_to_speed: Returnerar motsvarande speed_t fr angiven baud rate,
+*                    eller B0 ifall den inte stds.
+*
+*                    - baud: Baud rate.
+********************************************************************************/
+speed_t tty_baud_to_speed(const long baud)
+{
+   switch (baud)
+   {
+   case 9600: return B9600;
+   case 19200: return B19200;
+   case 38400: return B38400;
+   case 57600: return B57600;
+   case 115200: return B115200;
+   default: return B0;
+   }
+}
+
+/********************************************************************************
+* tty_configure_raw: Stller in en terminal fr r lsning. Ingen tolkning av
+*                    vagnretur, eko eller styrtecken sker, och en lsning
+*                    returnerar s fort minst ett tecken finns.
+*
+*                    - fd   : Terminalens filbeskrivare.
+*                    - speed: Baud rate.
+********************************************************************************/
+bool tty_configure_raw(const int fd, const speed_t speed)
+{
+   struct termios tio;
+   if (tcgetattr(fd, &tio) != 0) return false;
+
+   cfmakeraw(&tio);
+   tio.c_cflag |= CLOCAL | CREAD;
+   tio.c_cc[VMIN] = 1;
+   tio.c_cc[VTIME] = 0;
+   cfsetispeed(&tio, speed);
+   cfsetospeed(&tio, speed);
+   return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
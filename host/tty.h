@@ -0,0 +1,29 @@
+/********************************************************************************
+* tty.h: Instllning av seriella portar och pseudoterminaler fr r lsning
+*        av utskrifterna frn mikrodatorn.
+********************************************************************************/
+#ifndef TTY_H_
+#define TTY_H_
+
+/* Inkluderingsdirektiv: */
+#include <termios.h>
+
+/********************************************************************************
+* tty_baud_to_speed: Returnerar motsvarande speed_t fr angiven baud rate,
+*                    eller B0 ifall den inte stds.
+*
+*                    - baud: Baud rate, exempelvis 9600 som i tmp36_init.
+********************************************************************************/
+speed_t tty_baud_to_speed(const long baud);
+
+/********************************************************************************
+* tty_configure_raw: Stller in en terminal fr r lsning med tta databitar,
+*                    ingen paritet och en stoppbit, vilket motsvarar
+*                    serial_init. Returnerar false vid fel.
+*
+*                    - fd   : Terminalens filbeskrivare.
+*                    - speed: Baud rate.
+********************************************************************************/
+bool tty_configure_raw(const int fd, const speed_t speed);
+
+#endif /* TTY_H_ */